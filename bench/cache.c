@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the objects each thread holds at once.
+#define BATCH 64
+
+/// @brief Macro that define the number of batches per thread.
+#define ROUNDS 20000
+
+/// @brief Macro that define the largest number of threads.
+#define MAX_THREADS 4
+
+// An object as a connection or a request, costly to set up.
+struct object
+{
+    pthread_mutex_t lock;
+    uint64_t table[128];
+    char buffer[1024];
+};
+
+struct run
+{
+    const char *name;
+    void *(*get)(void);
+    void (*put)(void *object);
+};
+
+static blk_cache *cache;
+
+static void construct(void *ptr)
+{
+    struct object *object = ptr;
+    pthread_mutex_init(&object->lock, NULL);
+    for (size_t i = 0; i < 128; ++i)
+    {
+        object->table[i] = i * 0x9e3779b97f4a7c15ULL;
+    }
+
+    memset(object->buffer, 0, sizeof(object->buffer));
+}
+
+static void destruct(void *ptr)
+{
+    struct object *object = ptr;
+    pthread_mutex_destroy(&object->lock);
+}
+
+static void *malloc_get(void)
+{
+    void *object = malloc(sizeof(struct object));
+    construct(object);
+    return object;
+}
+
+static void malloc_put(void *object)
+{
+    destruct(object);
+    free(object);
+}
+
+static void *cache_get(void)
+{
+    return blk_cache_alloc(cache);
+}
+
+static void cache_put(void *object)
+{
+    blk_cache_free(cache, object);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void *worker(void *arg)
+{
+    const struct run *run = arg;
+    struct object *volatile objects[BATCH];
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (int i = 0; i < BATCH; ++i)
+        {
+            objects[i] = run->get();
+            objects[i]->buffer[0] = 1;
+        }
+
+        for (int i = 0; i < BATCH; ++i)
+        {
+            objects[i]->buffer[0] = 0;
+            run->put(objects[i]);
+        }
+    }
+
+    return NULL;
+}
+
+static void measure(const struct run *run, int threads)
+{
+    pthread_t ids[MAX_THREADS];
+    uint64_t start = now_ns();
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_create(&ids[i], NULL, worker, (void *)run);
+    }
+
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(ids[i], NULL);
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    printf("%-6s %d thread%s: %6.1f ns per pair\n", run->name, threads,
+           threads > 1 ? "s" : " ",
+           (double)elapsed / ((uint64_t)ROUNDS * BATCH * threads));
+}
+
+int main(void)
+{
+    cache = blk_cache_create(sizeof(struct object), 0, construct, destruct);
+    if (!cache)
+    {
+        return 1;
+    }
+
+    const struct run runs[] = {
+        { "malloc", malloc_get, malloc_put },
+        { "cache", cache_get, cache_put },
+    };
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 4)
+    {
+        for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i)
+        {
+            measure(&runs[i], threads);
+        }
+    }
+
+    // Objects also go back through free().
+    void *object = blk_cache_alloc(cache);
+    free(object);
+    printf("usable size   : %zu\n", blk_usable_size(blk_cache_alloc(cache)));
+
+    blk_cache_destroy(cache);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/// @brief Macro that define the working set kept hot between operations.
+#define HOT_SIZE (512 * 1024)
+
+/// @brief Macro that define the number of operations per size.
+#define ROUNDS 20
+
+// The glibc allocator, still exported next to the interposed one.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+struct allocator
+{
+    const char *name;
+    void *(*malloc)(size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*free)(void *ptr);
+};
+
+static const size_t sizes[] = { 4 << 20, 16 << 20, 64 << 20 };
+
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t touch_hot(const uint64_t *hot)
+{
+    // Time a pass over the working set, slower when it was evicted.
+    uint64_t start = now_ns();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < HOT_SIZE / sizeof(uint64_t); i += 8)
+    {
+        sum += hot[i];
+    }
+
+    sink = sum;
+    return now_ns() - start;
+}
+
+static void run(const struct allocator *allocator, const uint64_t *hot)
+{
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        size_t size = sizes[i];
+        uint64_t calloc_ns = 0;
+        uint64_t realloc_ns = 0;
+        uint64_t calloc_hot_ns = 0;
+        uint64_t realloc_hot_ns = 0;
+        for (int round = 0; round < ROUNDS; ++round)
+        {
+            // Zero a block, as calloc() of a recycled buffer does.
+            touch_hot(hot);
+            uint64_t start = now_ns();
+            unsigned char *volatile block = allocator->calloc(1, size);
+            calloc_ns += now_ns() - start;
+            calloc_hot_ns += touch_hot(hot);
+
+            // The blocker keeps the block from growing in place.
+            memset(block, 1, size);
+            void *volatile blocker = allocator->malloc(64);
+            touch_hot(hot);
+            start = now_ns();
+            block = allocator->realloc(block, 2 * size);
+            realloc_ns += now_ns() - start;
+            realloc_hot_ns += touch_hot(hot);
+
+            sink += block[size - 1];
+            allocator->free(blocker);
+            allocator->free(block);
+        }
+
+        printf("%-5s %3zu MiB: calloc %6.2f GB/s, hot set %6.1f us | "
+               "realloc %6.2f GB/s, hot set %6.1f us\n",
+               allocator->name, size >> 20,
+               (double)size * ROUNDS / calloc_ns,
+               calloc_hot_ns / 1e3 / ROUNDS,
+               (double)size * ROUNDS / realloc_ns,
+               realloc_hot_ns / 1e3 / ROUNDS);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t *hot = malloc(HOT_SIZE);
+    memset(hot, 1, HOT_SIZE);
+    printf("cold hot set  : %.1f us\n", touch_hot(hot) / 1e3);
+    printf("warm hot set  : %.1f us\n", touch_hot(hot) / 1e3);
+
+    struct allocator blk = { argc > 1 ? "temp" : "nt", malloc, calloc,
+                             realloc, free };
+    run(&blk, hot);
+    if (argc > 1)
+    {
+        return 0;
+    }
+
+    struct allocator libc = { "libc", __libc_malloc, __libc_calloc,
+                              __libc_realloc, __libc_free };
+    run(&libc, hot);
+
+    // Again with regular copies, in a process reading the option.
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setenv("BLK_MALLOC_CONF", "nt_threshold:0", 1);
+        execl("/proc/self/exe", argv[0], "temporal", (char *)NULL);
+        _exit(1);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    free(hot);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
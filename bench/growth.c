@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the number of objects allocated while warming up.
+#define OBJECTS 1000000
+
+/// @brief Macro that define the size a growing buffer reaches.
+#define BUFFER_SIZE (16 << 20)
+
+// The glibc allocator, still exported next to the interposed one.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static void *objects[OBJECTS];
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void warm_up(const char *name, void *(*allocate)(size_t),
+                    void (*release)(void *))
+{
+    // Small objects that all stay alive, as a cache being filled.
+    unsigned int seed = 1;
+    uint64_t start = now_ns();
+    for (int i = 0; i < OBJECTS; ++i)
+    {
+        objects[i] = allocate(16 + rand_r(&seed) % 240);
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    printf("%-5s warm-up : %d objects, %5.1f ns per malloc\n", name, OBJECTS,
+           (double)elapsed / OBJECTS);
+
+    for (int i = 0; i < OBJECTS; ++i)
+    {
+        release(objects[i]);
+    }
+}
+
+static void grow(const char *name, void *(*resize)(void *, size_t),
+                 void (*release)(void *))
+{
+    // A buffer appended to, growing by 64 KiB at a time.
+    unsigned char *volatile buffer = NULL;
+    uint64_t start = now_ns();
+    for (size_t size = 65536; size <= BUFFER_SIZE; size += 65536)
+    {
+        buffer = resize(buffer, size);
+        buffer[size - 1] = 1;
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    printf("%-5s growth  : to %d MiB, %6.1f us per realloc\n", name,
+           BUFFER_SIZE >> 20, (double)elapsed / (BUFFER_SIZE / 65536) / 1e3);
+    release(buffer);
+}
+
+int main(void)
+{
+    warm_up("blk", malloc, free);
+    printf("blk   mapped  : %.1f MiB\n", blk_memory_mapped() / 1048576.0);
+    warm_up("libc", __libc_malloc, __libc_free);
+    grow("blk", realloc, free);
+    grow("libc", __libc_realloc, __libc_free);
+    return 0;
+}
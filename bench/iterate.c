@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the number of live blocks walked.
+#define OBJECTS 1000000
+
+struct walk
+{
+    size_t used;
+    size_t free;
+    size_t used_size;
+};
+
+static void *objects[OBJECTS];
+static volatile int walking;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void count(void *ptr, size_t size, int used, void *arg)
+{
+    struct walk *walk = arg;
+    (void)ptr;
+    if (used)
+    {
+        ++walk->used;
+        walk->used_size += size;
+    }
+    else
+    {
+        ++walk->free;
+    }
+}
+
+static void *mutator(void *arg)
+{
+    // Allocate during the walk, the longest call shows how long it waited.
+    uint64_t *longest = arg;
+    while (walking)
+    {
+        uint64_t start = now_ns();
+        void *volatile ptr = malloc(64);
+        uint64_t elapsed = now_ns() - start;
+        free(ptr);
+        if (elapsed > *longest)
+        {
+            *longest = elapsed;
+        }
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    unsigned int seed = 1;
+    for (int i = 0; i < OBJECTS; ++i)
+    {
+        objects[i] = malloc(16 + rand_r(&seed) % 240);
+    }
+
+    // Free one block out of 64, leaving holes.
+    for (int i = 0; i < OBJECTS; i += 64)
+    {
+        free(objects[i]);
+        objects[i] = NULL;
+    }
+
+    uint64_t longest = 0;
+    pthread_t thread;
+    walking = 1;
+    pthread_create(&thread, NULL, mutator, &longest);
+    sched_yield();
+
+    struct walk walk = { 0, 0, 0 };
+    uint64_t start = now_ns();
+    int ret = blk_heap_iterate(count, &walk);
+    uint64_t elapsed = now_ns() - start;
+    walking = 0;
+    pthread_join(thread, NULL);
+
+    printf("walk          : %zu used (%.1f MiB), %zu free, %.1f ms, "
+           "%.1f ns per block\n",
+           walk.used, walk.used_size / 1048576.0, walk.free, elapsed / 1e6,
+           (double)elapsed / (walk.used + walk.free));
+    printf("longest malloc: %.1f us during the walk\n", longest / 1e3);
+
+    // The blocks are left to the exit, this only times the walk.
+    malloc_info(0, stdout);
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/// @brief Macro that define get_mempolicy() flags to query a page node.
+#define MPOL_F_NODE_ADDR 3
+
+/// @brief Macro that define the number of rounds done by each thread.
+#define ROUNDS 2000
+
+/// @brief Macro that define the number of buffers allocated per round.
+#define BUFFERS 64
+
+struct worker
+{
+    pthread_t thread;
+    int cpu;
+    size_t operations;
+    size_t local;
+    size_t remote;
+    size_t corrupted;
+};
+
+static int page_node(void *ptr)
+{
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, ptr, MPOL_F_NODE_ADDR))
+    {
+        return -1;
+    }
+
+    return node;
+}
+
+static void *worker_routine(void *arg)
+{
+    struct worker *worker = arg;
+
+    // Pin the thread so its node does not change during the run.
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    unsigned int cpu;
+    unsigned int node;
+    getcpu(&cpu, &node);
+
+    unsigned int seed = worker->cpu + 1;
+    unsigned char *buffers[BUFFERS];
+    size_t sizes[BUFFERS];
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (int i = 0; i < BUFFERS; ++i)
+        {
+            sizes[i] = 64 + rand_r(&seed) % (64 * 1024);
+            buffers[i] = malloc(sizes[i]);
+            memset(buffers[i], i, sizes[i]);
+        }
+
+        for (int i = 0; i < BUFFERS; ++i)
+        {
+            // The last byte is on a page touched by this thread only.
+            unsigned char *last = buffers[i] + sizes[i] - 1;
+            if (buffers[i][0] != i || *last != i)
+            {
+                worker->corrupted += 1;
+            }
+
+            if (page_node(last) == (int)node)
+            {
+                worker->local += 1;
+            }
+            else
+            {
+                worker->remote += 1;
+            }
+
+            free(buffers[i]);
+        }
+
+        worker->operations += 2 * BUFFERS;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long threads = argc > 1 ? strtol(argv[1], NULL, 10) : cpus;
+    if (threads <= 0)
+    {
+        fprintf(stderr, "usage: %s [threads]\n", argv[0]);
+        return 1;
+    }
+
+    struct worker *workers = calloc(threads, sizeof(struct worker));
+    if (!workers)
+    {
+        return 1;
+    }
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long i = 0; i < threads; ++i)
+    {
+        workers[i].cpu = i % cpus;
+        pthread_create(&workers[i].thread, NULL, worker_routine, &workers[i]);
+    }
+
+    size_t operations = 0;
+    size_t local = 0;
+    size_t remote = 0;
+    size_t corrupted = 0;
+    for (long i = 0; i < threads; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+        operations += workers[i].operations;
+        local += workers[i].local;
+        remote += workers[i].remote;
+        corrupted += workers[i].corrupted;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds =
+        end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("threads      : %ld\n", threads);
+    printf("operations   : %zu\n", operations);
+    printf("throughput   : %.0f ops/s\n", operations / seconds);
+    printf("local pages  : %zu\n", local);
+    printf("remote pages : %zu\n", remote);
+    printf("corrupted    : %zu\n", corrupted);
+
+    free(workers);
+
+    // Most pages have to be local, all of them on a single node machine.
+    return corrupted == 0 && local > remote ? 0 : 1;
+}
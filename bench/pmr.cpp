@@ -0,0 +1,153 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/blk_allocator.hpp"
+
+/// @brief Macro that define the number of rounds of each workload.
+#define ROUNDS 4
+
+/// @brief Macro that define the number of elements of each container.
+#define ELEMENTS 4000
+
+/// @brief Resource going through malloc() and free(), the global arenas of the
+/// library. libstdc++ new_delete_resource() uses the aligned operator new,
+/// which still reaches glibc.
+class malloc_resource : public std::pmr::memory_resource
+{
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t) override
+    {
+        void *ptr = malloc(bytes);
+        if (!ptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        return ptr;
+    }
+
+    void do_deallocate(void *ptr, std::size_t, std::size_t) override
+    {
+        free(ptr);
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/// @brief Fill a vector then a hash map, and check their content.
+/// @param resource The resource of the containers.
+/// @return The number of wrong values found.
+static size_t workload(std::pmr::memory_resource *resource)
+{
+    size_t wrong = 0;
+
+    std::pmr::vector<std::pmr::vector<long>> vectors(resource);
+    for (long i = 0; i < ELEMENTS / 100; ++i)
+    {
+        vectors.emplace_back();
+        for (long j = 0; j < 100; ++j)
+        {
+            vectors.back().push_back(i * j);
+        }
+    }
+
+    for (long i = 0; i < ELEMENTS / 100; ++i)
+    {
+        for (long j = 0; j < 100; ++j)
+        {
+            wrong += vectors[i][j] != i * j;
+        }
+    }
+
+    std::pmr::unordered_map<long, std::pmr::string> map(resource);
+    for (long i = 0; i < ELEMENTS; ++i)
+    {
+        map.emplace(i, std::to_string(i * 7) + " a string not stored inline");
+    }
+
+    for (long i = 0; i < ELEMENTS; i += 2)
+    {
+        map.erase(i);
+    }
+
+    for (const auto &[key, value] : map)
+    {
+        std::string expected =
+            std::to_string(key * 7) + " a string not stored inline";
+        wrong += key % 2 == 0 || std::string_view(value) != expected;
+    }
+
+    return wrong;
+}
+
+/// @brief Run the workload and print its duration.
+/// @param name The name of the resource.
+/// @param resource The resource.
+/// @param wrong Incremented with the number of wrong values.
+/// @return The duration in ms.
+static double run(const char *name, std::pmr::memory_resource *resource,
+                  size_t *wrong)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        *wrong += workload(resource);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    printf("%-18s : %8.1f ms\n", name, ms);
+    return ms;
+}
+
+int main()
+{
+    size_t wrong = 0;
+
+    run("default resource", std::pmr::get_default_resource(), &wrong);
+
+    malloc_resource global;
+    run("malloc resource", &global, &wrong);
+
+    blk::heap_resource heap(1 << 20);
+    run("heap_resource", &heap, &wrong);
+
+    // The heap is dropped at once instead of freeing every node.
+    blk::heap_resource scratch(1 << 20);
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        auto *map = new std::pmr::unordered_map<long, long>(&scratch);
+        for (long i = 0; i < ELEMENTS; ++i)
+        {
+            map->emplace(i, i);
+        }
+
+        wrong += map->size() != ELEMENTS;
+        scratch.release();
+        ::operator delete(map);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    printf("%-18s : %8.1f ms\n", "heap release",
+           std::chrono::duration<double, std::milli>(end - start).count());
+
+    // Blocks are sized for the request, allocate_at_least() sees the slack.
+    blk::allocator<char> alloc(heap);
+    auto result = alloc.allocate_at_least(1);
+    wrong += result.count < 1;
+    alloc.deallocate(result.ptr, result.count);
+
+    printf("%-18s : %8zu\n", "wrong values", wrong);
+    return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/// @brief Macro that define the number of threads allocating at once.
+#define THREADS 4
+
+/// @brief Macro that define the number of buffers allocated by each thread.
+#define ITERATIONS 2000
+
+/// @brief Macro that define the smallest buffer, larger ones get a span of
+/// their own which is unmapped when they are freed.
+#define MIN_BUFFER (256 * 1024)
+
+/// @brief Macro that define the range of the buffer sizes.
+#define BUFFER_RANGE (768 * 1024)
+
+struct worker
+{
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t malloc_ns[ITERATIONS];
+    uint64_t free_ns[ITERATIONS];
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void *worker_routine(void *arg)
+{
+    struct worker *worker = arg;
+    for (int i = 0; i < ITERATIONS; ++i)
+    {
+        size_t size = MIN_BUFFER + rand_r(&worker->seed) % BUFFER_RANGE;
+
+        uint64_t start = now_ns();
+        char *buffer = malloc(size);
+        worker->malloc_ns[i] = now_ns() - start;
+
+        // Touch every page so there is something to tear down.
+        for (size_t offset = 0; offset < size; offset += 4096)
+        {
+            buffer[offset] = (char)i;
+        }
+
+        start = now_ns();
+        free(buffer);
+        worker->free_ns[i] = now_ns() - start;
+    }
+
+    return NULL;
+}
+
+static int compare(const void *lhs, const void *rhs)
+{
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+static void print_percentiles(const char *name, uint64_t *values, size_t n)
+{
+    qsort(values, n, sizeof(*values), compare);
+    printf("%-6s (us)   : p50 %8.1f  p99 %8.1f  p99.9 %8.1f  max %8.1f\n",
+           name, values[n / 2] / 1e3, values[n * 99 / 100] / 1e3,
+           values[n * 999 / 1000] / 1e3, values[n - 1] / 1e3);
+}
+
+static int run(void)
+{
+    static struct worker workers[THREADS];
+    static uint64_t malloc_ns[THREADS * ITERATIONS];
+    static uint64_t free_ns[THREADS * ITERATIONS];
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < THREADS; ++i)
+    {
+        workers[i].seed = i + 1;
+        pthread_create(&workers[i].thread, NULL, worker_routine, &workers[i]);
+    }
+
+    for (int i = 0; i < THREADS; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+        memcpy(malloc_ns + i * ITERATIONS, workers[i].malloc_ns,
+               sizeof(workers[i].malloc_ns));
+        memcpy(free_ns + i * ITERATIONS, workers[i].free_ns,
+               sizeof(workers[i].free_ns));
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+
+    printf("configuration : %s\n", getenv("BLK_MALLOC_CONF"));
+    printf("throughput    : %.0f buffers/s\n", THREADS * ITERATIONS / seconds);
+    print_percentiles("malloc", malloc_ns, THREADS * ITERATIONS);
+    print_percentiles("free", free_ns, THREADS * ITERATIONS);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "run"))
+    {
+        return run();
+    }
+
+    // The configuration is read when the library is loaded, so each one runs
+    // in a new process.
+    const char *modes[] = { "async_release:false", "async_release:true" };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            setenv("BLK_MALLOC_CONF", modes[i], 1);
+            execl("/proc/self/exe", argv[0], "run", (char *)NULL);
+            _exit(127);
+        }
+
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the number of entries of the cache.
+#define ENTRIES 100000
+
+/// @brief Macro that define the number of buckets of its hash table.
+#define BUCKETS 65536
+
+/// @brief Macro that define the number of worker processes.
+#define WORKERS 4
+
+/// @brief Macro that define the allocations done by each worker.
+#define OPERATIONS 200000
+
+/// @brief Macro that define the size of the heaps.
+#define HEAP_SIZE (128 << 20)
+
+// Entries are linked by offsets, valid in every process.
+struct entry
+{
+    size_t next;
+    uint64_t key;
+    size_t length;
+    unsigned char value[];
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static size_t value_length(uint64_t key)
+{
+    return 32 + key * 7919 % 480;
+}
+
+static void build(blk_shared_heap *heap)
+{
+    size_t *table = blk_shared_heap_malloc(heap, BUCKETS * sizeof(size_t));
+    memset(table, 0, BUCKETS * sizeof(size_t));
+    for (uint64_t key = 0; key < ENTRIES; ++key)
+    {
+        size_t length = value_length(key);
+        struct entry *entry =
+            blk_shared_heap_malloc(heap, sizeof(*entry) + length);
+        entry->key = key;
+        entry->length = length;
+        memset(entry->value, (int)key, length);
+        entry->next = table[key % BUCKETS];
+        table[key % BUCKETS] = blk_shared_heap_offset(heap, entry);
+    }
+
+    blk_shared_heap_set_root(heap, table);
+}
+
+static size_t lookup_all(blk_shared_heap *heap)
+{
+    // Every entry must be found with its value.
+    size_t *table = blk_shared_heap_root(heap);
+    size_t found = 0;
+    for (uint64_t key = 0; table && key < ENTRIES; ++key)
+    {
+        struct entry *entry =
+            blk_shared_heap_pointer(heap, table[key % BUCKETS]);
+        while (entry && entry->key != key)
+        {
+            entry = blk_shared_heap_pointer(heap, entry->next);
+        }
+
+        found += entry && entry->length == value_length(key)
+            && entry->value[entry->length - 1] == (unsigned char)key;
+    }
+
+    return found;
+}
+
+static int worker(int fd, int index)
+{
+    // Shift the mappings so the heap lands at another address than in the
+    // parent.
+    mmap(NULL, (index + 1) << 20, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+         0);
+    blk_shared_heap *heap = blk_shared_heap_open(fd);
+    if (!heap)
+    {
+        return 1;
+    }
+
+    void *blocks[64] = { 0 };
+    unsigned int seed = index + 1;
+    for (int i = 0; i < OPERATIONS; ++i)
+    {
+        int slot = rand_r(&seed) % 64;
+        blk_shared_heap_free(heap, blocks[slot]);
+        blocks[slot] = blk_shared_heap_malloc(heap, 16 + rand_r(&seed) % 1024);
+    }
+
+    for (int i = 0; i < 64; ++i)
+    {
+        blk_shared_heap_free(heap, blocks[i]);
+    }
+
+    return lookup_all(heap) == ENTRIES ? 0 : 1;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/blk-shared-XXXXXX";
+    int file = mkstemp(path);
+    int memfd = memfd_create("blk-shared", 0);
+    if (file < 0 || memfd < 0)
+    {
+        return 1;
+    }
+
+    unlink(path);
+
+    // Build a cache in a file, as a service filling it after a cold start.
+    blk_shared_heap *heap = blk_shared_heap_create(file, HEAP_SIZE);
+    uint64_t start = now_ns();
+    build(heap);
+    uint64_t built = now_ns() - start;
+    blk_shared_heap_close(heap);
+
+    // Restart: map it again instead of rebuilding it.
+    start = now_ns();
+    heap = blk_shared_heap_open(file);
+    uint64_t opened = now_ns() - start;
+    size_t found = heap ? lookup_all(heap) : 0;
+    printf("entries       : %d\n", ENTRIES);
+    printf("build         : %.1f ms\n", built / 1e6);
+    printf("reopen        : %.1f ms, %zu entries found\n", opened / 1e6,
+           found);
+
+    // Workers sharing a copy of the cache over memfd, allocating and freeing
+    // in it at the same time.
+    blk_shared_heap *shared = blk_shared_heap_create(memfd, HEAP_SIZE);
+    build(shared);
+    start = now_ns();
+    for (int i = 0; i < WORKERS; ++i)
+    {
+        if (fork() == 0)
+        {
+            _exit(worker(memfd, i));
+        }
+    }
+
+    int failed = 0;
+    for (int i = 0; i < WORKERS; ++i)
+    {
+        int status;
+        wait(&status);
+        failed += !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    printf("workers       : %d x %d malloc/free, %.1f ns per op, %d failed\n",
+           WORKERS, OPERATIONS, (double)elapsed / (WORKERS * OPERATIONS),
+           failed);
+
+    // The heap must still hold exactly the cache once they are done.
+    found = lookup_all(shared);
+    printf("after workers : %zu entries found\n", found);
+    return found == ENTRIES && !failed && heap ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/// @brief Macro that define the number of objects kept alive.
+#define OBJECTS 16384
+
+/// @brief Macro that define the number of free and malloc pairs measured.
+#define OPERATIONS 200000
+
+/// @brief Macro that define the number of counters read.
+#define COUNTERS 3
+
+struct counter
+{
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+};
+
+static struct counter counters[COUNTERS] = {
+    { "cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1 },
+    { "L1d misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      -1 },
+    { "page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1 },
+};
+
+static void counters_open(void)
+{
+    for (int i = 0; i < COUNTERS; ++i)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counters[i].type;
+        attr.config = counters[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // Missing on virtual machines and with a strict perf_event_paranoid.
+        counters[i].fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void counters_enable(int request)
+{
+    for (int i = 0; i < COUNTERS; ++i)
+    {
+        if (counters[i].fd >= 0)
+        {
+            ioctl(counters[i].fd, request, 0);
+        }
+    }
+}
+
+static void counters_print(double operations)
+{
+    for (int i = 0; i < COUNTERS; ++i)
+    {
+        uint64_t value;
+        if (counters[i].fd < 0
+            || read(counters[i].fd, &value, sizeof(value)) != sizeof(value))
+        {
+            printf("%-13s: n/a\n", counters[i].name);
+            continue;
+        }
+
+        printf("%-13s: %.3f per op\n", counters[i].name, value / operations);
+    }
+}
+
+static int run(void)
+{
+    static void *objects[OBJECTS];
+    static size_t sizes[OBJECTS];
+    unsigned int seed = 1;
+
+    // Written once, the measured loop never touches the payload again.
+    for (int i = 0; i < OBJECTS; ++i)
+    {
+        sizes[i] = 1 + rand_r(&seed) % 256;
+        objects[i] = malloc(sizes[i]);
+        memset(objects[i], i, sizes[i]);
+    }
+
+    counters_open();
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    counters_enable(PERF_EVENT_IOC_ENABLE);
+
+    for (int op = 0; op < OPERATIONS; ++op)
+    {
+        int i = rand_r(&seed) % OBJECTS;
+        free(objects[i]);
+        sizes[i] = 1 + rand_r(&seed) % 256;
+        objects[i] = malloc(sizes[i]);
+    }
+
+    counters_enable(PERF_EVENT_IOC_DISABLE);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds =
+        end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    size_t invalid = 0;
+    for (int i = 0; i < OBJECTS; ++i)
+    {
+        if (!objects[i] || malloc_usable_size(objects[i]) < sizes[i])
+        {
+            invalid += 1;
+        }
+
+        free(objects[i]);
+    }
+
+    printf("slabs        : %s\n", getenv("BLK_SLAB"));
+    printf("latency      : %.1f ns per op\n", seconds * 1e9 / OPERATIONS);
+    counters_print(OPERATIONS);
+    printf("invalid      : %zu\n", invalid);
+    return invalid ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "run"))
+    {
+        return run();
+    }
+
+    // The mode is read when the allocator starts, so each one runs in a new
+    // process.
+    const char *modes[] = { "0", "1" };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            setenv("BLK_SLAB", modes[i], 1);
+            execl("/proc/self/exe", argv[0], "run", (char *)NULL);
+            _exit(127);
+        }
+
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/// @brief Macro that define the number of allocations measured, the first
+/// ones of the process.
+#define ALLOCATIONS 20000
+
+/// @brief Macro that define the largest allocation.
+#define MAX_SIZE 4096
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int compare(const void *lhs, const void *rhs)
+{
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+static int run(void)
+{
+    static void *objects[ALLOCATIONS];
+    static uint64_t latencies[ALLOCATIONS];
+    unsigned int seed = 1;
+
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+
+    // Small requests mostly, as a service answering its first requests.
+    uint64_t start = now_ns();
+    for (int i = 0; i < ALLOCATIONS; ++i)
+    {
+        size_t size = rand_r(&seed) % 8 ? 1 + rand_r(&seed) % 256
+                                        : 1 + rand_r(&seed) % MAX_SIZE;
+
+        uint64_t begin = now_ns();
+        objects[i] = malloc(size);
+        memset(objects[i], i, size);
+        latencies[i] = now_ns() - begin;
+    }
+
+    uint64_t total = now_ns() - start;
+
+    struct rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    qsort(latencies, ALLOCATIONS, sizeof(*latencies), compare);
+    printf("configuration : %s\n", getenv("BLK_MALLOC_CONF"));
+    printf("first allocs  : %.1f ms\n", total / 1e6);
+    printf("latency (ns)  : p50 %6lu  p99 %6lu  max %8lu\n",
+           (unsigned long)latencies[ALLOCATIONS / 2],
+           (unsigned long)latencies[ALLOCATIONS * 99 / 100],
+           (unsigned long)latencies[ALLOCATIONS - 1]);
+    printf("page faults   : %ld\n", after.ru_minflt - before.ru_minflt);
+
+    for (int i = 0; i < ALLOCATIONS; ++i)
+    {
+        free(objects[i]);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "run"))
+    {
+        return run();
+    }
+
+    // The reservation is done when the library is loaded, so each
+    // configuration runs in a new process.
+    const char *modes[] = { "reserve:0", "reserve:32m",
+                            "reserve:32m,populate:true,warm_caches:true" };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            setenv("BLK_MALLOC_CONF", modes[i], 1);
+            execl("/proc/self/exe", argv[0], "run", (char *)NULL);
+            _exit(127);
+        }
+
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
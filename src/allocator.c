@@ -1,72 +1,138 @@
+#define _GNU_SOURCE
+
 #include "allocator.h"
 
 #include <string.h>
 
+#include "config.h"
 #include "convert.h"
-
-static void *blk_new_page(size_t size);
+#include "copy.h"
+#include "latency.h"
+#include "limit.h"
+#include "numa.h"
+#include "pagemap.h"
+#include "probe.h"
+#include "reclaim.h"
+
+static void *blk_new_page(blk_allocator *blka, size_t size);
+static blk_meta *blk_append_page(blk_allocator *blka, size_t size);
+static blk_meta *blk_setup_span(blk_span *span);
+static void blk_unmap_span(blk_allocator *blka, blk_span *span);
 static void blk_try_free_page(blk_allocator *blka, blk_meta *blk);
+static void blk_unmap_page(blk_allocator *blka, blk_meta *blk);
 static void blk_extend_allocator(blk_allocator *blka, size_t size);
+static bool blk_grow_in_place(blk_allocator *blka, size_t size);
+static bool blk_grow_wilderness(blk_allocator *blka, size_t size);
+static blk_meta *blk_carve(blk_allocator *blka, size_t size);
 static void blk_split(blk_meta *blk, size_t size);
 static blk_meta *blk_merge(blk_allocator *blka, blk_meta *blk);
 static uint32_t blk_compute_checksum(blk_meta *blk);
 static void blk_remove_from_free_list(blk_allocator *blka, blk_meta *blk);
+static void blk_unretain(blk_allocator *blka, blk_meta *blk);
+static void blk_untrim(blk_allocator *blka, blk_meta *blk);
+static void blk_release(blk_allocator *blka, blk_meta *blk);
 
-size_t blk_align_size(size_t size)
+// Checksums are not computed while disabled, every header is then valid.
+static bool checksums_enabled = true;
+
+static void *blk_new_page(blk_allocator *blka, size_t size)
 {
-    // If this is already aligned, do nothing.
-    if (size % sizeof(long double) == 0)
+    // Compute size neeeded, rounded up to whole pages.
+    size_t page_size = PAGE_SIZE;
+    size_t memory_used;
+    if (__builtin_add_overflow(blk_align_size(size),
+                               sizeof(blk_span) + 2 * sizeof(blk_meta)
+                                   + page_size - 1,
+                               &memory_used))
     {
-        return size;
+        return NULL;
     }
 
-    // Calculate the padding to add.
-    size_t padding = sizeof(long double) - size % sizeof(long double);
+    memory_used &= ~(page_size - 1);
 
-    // Check for an overflow.
-    unsigned int aligned_size;
-    if (__builtin_uadd_overflow(size, padding, &aligned_size))
+    // Stay within the memory budget.
+    if (!blk_limit_charge(memory_used))
     {
-        // If it overflows, return SIZE_MAX.
-        return SIZE_MAX;
+        return NULL;
     }
 
-    // Return the result.
-    return aligned_size;
-}
+    // Map the memory.
+    void *addr = mmap(NULL, memory_used, PROT_FLAGS, MAP_FLAGS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        blk_limit_uncharge(memory_used);
+        return NULL;
+    }
 
-static void *blk_new_page(size_t size)
-{
-    // Compute size neeeded.
-    size_t memory_used = PAGE_SIZE;
-    size_t memory_needed = 2 * sizeof(blk_meta) + blk_align_size(size);
-    while (memory_used < memory_needed)
+    blk_latency_note(PATH_EXTEND);
+    BLK_PROBE3(page__map, blka, addr, memory_used);
+
+    // Place the pages on the arena node before they are touched.
+    if (blka->node >= 0)
     {
-        memory_used += PAGE_SIZE;
+        blk_numa_bind(addr, memory_used, blka->node);
     }
 
-    // Map the memory.
-    void *addr = mmap(NULL, memory_used, PROT_FLAGS, MAP_FLAGS, -1, 0);
-    if (addr == MAP_FAILED)
+    blk_config_advise(addr, memory_used);
+
+    // Index the pages so pointers can be traced back to the span.
+    blk_span *span = addr;
+    if (!blk_pagemap_set(addr, memory_used, span))
     {
+        blk_pagemap_set(addr, memory_used, NULL);
+        munmap(addr, memory_used);
+        blk_limit_uncharge(memory_used);
         return NULL;
     }
 
-    // Create metadata of the first block.
-    blk_meta *blk = addr;
+    // Append the span to the list of the allocator.
+    span->size = memory_used;
+    span->owner = blka;
+    span->is_reserved = false;
+    span->next = NULL;
+    span->prev = blka->last_span;
+    if (blka->last_span)
+    {
+        blka->last_span->next = span;
+    }
+    else
+    {
+        blka->spans = span;
+    }
+
+    blka->last_span = span;
+    blka->size += memory_used;
+
+    // The walks that reached the end go on with the new span.
+    for (struct blk_span_cursor *cursor = blka->cursors; cursor;
+         cursor = cursor->next)
+    {
+        if (!cursor->span)
+        {
+            cursor->span = span;
+        }
+    }
+
+    return blk_setup_span(span);
+}
+
+static blk_meta *blk_setup_span(blk_span *span)
+{
+    // Create metadata of the first block, right after the span header.
+    uint8_t *addr_p = SPAN_TO_U8(span) + sizeof(blk_span);
+    blk_meta *blk = U8_TO_BLK(addr_p);
 
     // Reset all the bytes.
-    memset(addr, 0, sizeof(blk_meta));
-    blk->size = memory_used - 2 * sizeof(blk_meta);
+    memset(addr_p, 0, sizeof(blk_meta));
+    blk->size = span->size - sizeof(blk_span) - 2 * sizeof(blk_meta);
     blk->is_free = true;
 
     // Create the last block.
-    uint8_t *addr_p = addr;
     addr_p += sizeof(blk_meta) + blk->size;
     blk_meta *page_end_blk = U8_TO_BLK(addr_p);
     memset(addr_p, 0, sizeof(blk_meta));
     page_end_blk->is_free = false;
-    page_end_blk->garbage = memory_used;
+    page_end_blk->garbage = span->size;
 
     // Link blocks.
     page_end_blk->prev = blk;
@@ -76,94 +142,251 @@ static void *blk_new_page(size_t size)
     blk->checksum = blk_compute_checksum(blk);
     page_end_blk->checksum = blk_compute_checksum(page_end_blk);
 
-    addr_p = addr;
-    return addr_p;
+    return blk;
 }
 
-void blk_init_allocator(blk_allocator *blka, size_t size)
+static void blk_unmap_span(blk_allocator *blka, blk_span *span)
 {
-    blka->meta = blk_new_page(size);
-    blka->free_list = blka->meta;
+    // Unlink the span.
+    if (span->prev)
+    {
+        span->prev->next = span->next;
+    }
+    else
+    {
+        blka->spans = span->next;
+    }
 
-    // Compute size neeeded.
-    size_t memory_used = PAGE_SIZE;
-    size_t memory_needed = 2 * sizeof(blk_meta) + blk_align_size(size);
-    while (memory_used < memory_needed)
+    if (span->next)
+    {
+        span->next->prev = span->prev;
+    }
+    else
     {
-        memory_used += PAGE_SIZE;
+        blka->last_span = span->prev;
     }
 
-    blka->size = memory_used;
-    pthread_mutex_init(&blka->lock, NULL);
-}
+    // The walks about to reach the span skip it.
+    for (struct blk_span_cursor *cursor = blka->cursors; cursor;
+         cursor = cursor->next)
+    {
+        if (cursor->span == span)
+        {
+            cursor->span = span->next;
+        }
+    }
 
-static void blk_try_free_page(blk_allocator *blka, blk_meta *blk)
-{
-    bool is_first = false;
-    if (blka->meta == blk)
+    if (span->is_reserved)
     {
-        is_first = true;
+        blka->reserved -= span->size;
     }
 
+    // The page map is cleared first, once unmapped the range may be mapped
+    // again by another thread.
+    blka->size -= span->size;
+    blk_pagemap_set(span, span->size, NULL);
+    size_t threshold = blk_config_get()->mmap_threshold;
+    blk_latency_note(threshold && span->size >= threshold ? PATH_MMAP
+                                                          : PATH_EXTEND);
+
+    // Unmap memory, or let the background thread do it outside of the lock.
+    if (blk_reclaim_enabled())
+    {
+        blk_reclaim_push(span, span->size);
+    }
+    else
+    {
+        size_t size = span->size;
+        munmap(span, size);
+        blk_limit_uncharge(size);
+    }
+}
+
+void blk_init_allocator(blk_allocator *blka, size_t size)
+{
+    blk_init_arena(blka, size, 0, -1);
+}
+
+void blk_init_arena(blk_allocator *blka, size_t size, uint8_t id, int node)
+{
+    blka->id = id;
+    blka->node = node;
+    blka->meta = NULL;
+    blka->free_list = NULL;
+    blka->wilderness = NULL;
+    blka->spans = NULL;
+    blka->last_span = NULL;
+    blka->cursors = NULL;
+    blka->size = 0;
+    blka->retained = 0;
+    blka->reserved = 0;
+    blka->trimmed = 0;
+    blk_lock_init(&blka->lock);
+
+    // Map the first page, the wilderness until it is used up.
+    blk_grow_wilderness(blka, size);
+}
+
+static void blk_try_free_page(blk_allocator *blka, blk_meta *blk)
+{
     // Check if the whole page is free.
-    if (blk->next && blk->next->garbage
+    if (!blk->is_retained && blk->next && blk->next->garbage
         && (!blk->prev || (blk->prev && blk->prev->garbage)))
     {
-        // Remove the big block from the free list.
-        blk_remove_from_free_list(blka, blk);
-
-        // Remove it from the normal list.
-        if (!is_first)
+        // The reserved spans are always kept, the others while the
+        // allocator is within its retention budget.
+        blk_span *span = U8_TO_SPAN(BLK_TO_U8(blk) - sizeof(blk_span));
+        if (span->is_reserved)
         {
-            blk->prev->next = blk->next->next;
-            blk->prev->checksum = blk_compute_checksum(blk->prev);
+            return;
         }
-        else
+
+        if (blka->retained + span->size <= blk_config_get()->retain)
         {
-            blka->meta = blk->next->next;
+            blka->retained += span->size;
+            blk->is_retained = true;
+            blk->checksum = blk_compute_checksum(blk);
+            BLK_PROBE3(page__retain, blka, span, span->size);
+            return;
         }
 
-        if (blk->next->next)
+        BLK_PROBE3(page__unmap, blka, span, span->size);
+        blk_unmap_page(blka, blk);
+    }
+}
+
+static void blk_unmap_page(blk_allocator *blka, blk_meta *blk)
+{
+    // Remove the big block from the free list.
+    blk_remove_from_free_list(blka, blk);
+
+    // Remove it from the normal list.
+    if (blka->meta != blk)
+    {
+        blk->prev->next = blk->next->next;
+        blk->prev->checksum = blk_compute_checksum(blk->prev);
+    }
+    else
+    {
+        blka->meta = blk->next->next;
+    }
+
+    if (blk->next->next)
+    {
+        blk->next->next->prev = blk->prev;
+        blk->next->next->checksum = blk_compute_checksum(blk->next->next);
+    }
+
+    if (blka->wilderness == blk)
+    {
+        blka->wilderness = NULL;
+    }
+
+    // Unmap the span holding the page.
+    blk_unmap_span(blka, U8_TO_SPAN(BLK_TO_U8(blk) - sizeof(blk_span)));
+}
+
+size_t blk_release_retained(blk_allocator *blka)
+{
+    // The reserved spans go too, the budget matters more than the latency.
+    size_t released = 0;
+    blk_span *span = blka->spans;
+    while (span)
+    {
+        blk_span *next = span->next;
+        blk_meta *blk = U8_TO_BLK(SPAN_TO_U8(span) + sizeof(blk_span));
+        bool is_empty = blk->is_free && blk->next && blk->next->garbage;
+        if (is_empty && (blk->is_retained || span->is_reserved))
         {
-            blk->next->next->prev = blk->prev;
-            blk->next->next->checksum = blk_compute_checksum(blk->next->next);
+            released += span->size;
+            blk_unmap_page(blka, blk);
         }
 
-        // Unmap memory.
-        munmap(BLK_TO_U8(blk), blk->next->garbage);
+        span = next;
+    }
+
+    return released;
+}
+
+bool blk_reserve(blk_allocator *blka, size_t size, bool populate)
+{
+    blk_span *last_span = blka->last_span;
+    blk_extend_allocator(blka, size);
+    if (blka->last_span == last_span)
+    {
+        return false;
+    }
+
+    blk_span *span = blka->last_span;
+    span->is_reserved = true;
+    blka->reserved += span->size;
+    if (!populate)
+    {
+        return true;
     }
+
+#ifdef MADV_POPULATE_WRITE
+    // Fault every page in with a single call on recent kernels.
+    if (!madvise(span, span->size, MADV_POPULATE_WRITE))
+    {
+        return true;
+    }
+#endif
+
+    // Otherwise write each page, keeping its bytes.
+    uintptr_t page_size = PAGE_SIZE;
+    for (size_t offset = 0; offset < span->size; offset += page_size)
+    {
+        volatile uint8_t *byte = SPAN_TO_U8(span) + offset;
+        *byte = *byte;
+    }
+
+    return true;
 }
 
 void blk_cleanup_allocator(blk_allocator *blka)
 {
-    pthread_mutex_destroy(&blka->lock);
+    // The trimmed pages are uncharged with their span.
+    blk_limit_recharge(blka->trimmed);
+    blka->trimmed = 0;
 
-    // Get the last block of the previous page.
-    blk_meta *page_end_blk = blka->meta;
-    while (page_end_blk->next)
+    // Unmap every span without looking at the blocks.
+    while (blka->spans)
     {
-        page_end_blk = page_end_blk->next;
+        blk_unmap_span(blka, blka->spans);
     }
 
-    // Save the size of this page and go back 1 time.
-    size_t current_page_size = page_end_blk->garbage;
-    page_end_blk = page_end_blk->prev;
+    blka->meta = NULL;
+    blka->free_list = NULL;
+    blka->wilderness = NULL;
+    blka->retained = 0;
+    blka->reserved = 0;
+}
 
-    // Stop when we are at the first block.
-    while (page_end_blk && page_end_blk->prev)
+void blk_reset_allocator(blk_allocator *blka)
+{
+    blk_span *first = blka->spans;
+    if (!first)
     {
-        while (page_end_blk->prev && page_end_blk->size == 0)
-        {
-            page_end_blk = page_end_blk->prev;
-        }
+        return;
+    }
 
-        munmap(page_end_blk->next, current_page_size);
+    // The trimmed pages are uncharged with their span, or counted again with
+    // the first one.
+    blk_limit_recharge(blka->trimmed);
+    blka->trimmed = 0;
 
-        current_page_size = page_end_blk->garbage;
-        page_end_blk = page_end_blk->prev;
+    // Unmap every span but the first one.
+    while (first->next)
+    {
+        blk_unmap_span(blka, blka->last_span);
     }
 
-    munmap(blka, blka->size);
+    // Turn the first span back into a single free block, the wilderness.
+    blka->meta = blk_setup_span(first);
+    blka->free_list = NULL;
+    blka->wilderness = blka->meta;
+    blka->retained = 0;
 }
 
 static void __blk_insert_to_free_list(blk_allocator *blka, blk_meta *blk)
@@ -192,28 +415,204 @@ static void __blk_insert_to_free_list(blk_allocator *blka, blk_meta *blk)
     blka->free_list = blk;
 }
 
-static void blk_extend_allocator(blk_allocator *blka, size_t size)
+static blk_meta *blk_append_page(blk_allocator *blka, size_t size)
 {
+    // The new span is appended after the current last one.
+    blk_span *last_span = blka->last_span;
+
     // Create a new page.
-    blk_meta *new_blk = blk_new_page(size);
+    blk_meta *new_blk = blk_new_page(blka, size);
+    if (!new_blk)
+    {
+        return NULL;
+    }
 
-    // Get the last block of the previous page.
-    blk_meta *last_blk = blka->meta;
-    while (last_blk->next)
+    // All the pages may have been unmapped, start over.
+    if (!last_span)
     {
-        last_blk = last_blk->next;
+        blka->meta = new_blk;
+        return new_blk;
     }
 
+    // Get the last block of the previous page, at the end of its span.
+    uint8_t *addr_p = SPAN_TO_U8(last_span) + last_span->size;
+    blk_meta *last_blk = U8_TO_BLK(addr_p - sizeof(blk_meta));
+
     // Link the two pages.
     last_blk->next = new_blk;
     new_blk->prev = last_blk;
+    last_blk->checksum = blk_compute_checksum(last_blk);
+
+    return new_blk;
+}
+
+static void blk_extend_allocator(blk_allocator *blka, size_t size)
+{
+    blk_meta *new_blk = blk_append_page(blka, size);
+    if (!new_blk)
+    {
+        return;
+    }
 
     // Insert new block in the free list.
     __blk_insert_to_free_list(blka, new_blk);
+    new_blk->checksum = blk_compute_checksum(new_blk);
+}
+
+static bool blk_grow_in_place(blk_allocator *blka, size_t size)
+{
+    // The span ends with the block after the wilderness.
+    blk_meta *wilderness = blka->wilderness;
+    blk_meta *end = wilderness->next;
+    blk_span *span =
+        U8_TO_SPAN(BLK_TO_U8(end) + sizeof(blk_meta) - end->garbage);
+
+    // Grow by as much as a new span would hold, rounded up to whole pages.
+    size_t page_size = PAGE_SIZE;
+    size_t growth = blka->size < WILDERNESS_MAX_GROWTH ? blka->size
+                                                       : WILDERNESS_MAX_GROWTH;
+    if (growth < size - wilderness->size)
+    {
+        growth = size - wilderness->size;
+    }
+
+    size_t new_size;
+    if (__builtin_add_overflow(growth, page_size - 1, &growth)
+        || __builtin_add_overflow(span->size, growth & ~(page_size - 1),
+                                  &new_size))
+    {
+        return false;
+    }
+
+    growth &= ~(page_size - 1);
+    if (!blk_limit_charge(growth))
+    {
+        return false;
+    }
+
+    // Without MREMAP_MAYMOVE it fails when the next pages are taken.
+    if (mremap(span, span->size, new_size, 0) == MAP_FAILED)
+    {
+        blk_limit_uncharge(growth);
+        return false;
+    }
+
+    uint8_t *added = SPAN_TO_U8(span) + span->size;
+    if (!blk_pagemap_set(added, growth, span))
+    {
+        blk_pagemap_set(added, growth, NULL);
+        mremap(span, new_size, span->size, 0);
+        blk_limit_uncharge(growth);
+        return false;
+    }
+
+    blk_latency_note(PATH_EXTEND);
+    BLK_PROBE3(page__map, blka, added, growth);
+    if (blka->node >= 0)
+    {
+        blk_numa_bind(added, growth, blka->node);
+    }
+
+    blk_config_advise(added, growth);
+
+    // Its size changes, it is no longer counted as retained nor trimmed.
+    blk_unretain(blka, wilderness);
+    blk_untrim(blka, wilderness);
+
+    // Move the last block to the new end of the span.
+    blk_meta *new_end = U8_TO_BLK(added + growth - sizeof(blk_meta));
+    memset(new_end, 0, sizeof(blk_meta));
+    new_end->garbage = new_size;
+    new_end->prev = wilderness;
+    new_end->next = end->next;
+    if (new_end->next)
+    {
+        new_end->next->prev = new_end;
+        new_end->next->checksum = blk_compute_checksum(new_end->next);
+    }
+
+    wilderness->next = new_end;
+    wilderness->size += growth;
+    span->size = new_size;
+    blka->size += growth;
+    if (span->is_reserved)
+    {
+        blka->reserved += growth;
+    }
 
     // Compute the checksums.
-    last_blk->checksum = blk_compute_checksum(last_blk);
+    new_end->checksum = blk_compute_checksum(new_end);
+    wilderness->checksum = blk_compute_checksum(wilderness);
+    return true;
+}
+
+static bool blk_grow_wilderness(blk_allocator *blka, size_t size)
+{
+    if (blka->wilderness && blk_grow_in_place(blka, size))
+    {
+        return true;
+    }
+
+    // Double the memory mapped, down to the request close to the limits.
+    size_t growth = blka->size < WILDERNESS_MAX_GROWTH ? blka->size
+                                                       : WILDERNESS_MAX_GROWTH;
+    blk_meta *new_blk = NULL;
+    if (growth > size)
+    {
+        new_blk = blk_append_page(blka, growth);
+    }
+
+    if (!new_blk)
+    {
+        new_blk = blk_append_page(blka, size);
+        if (!new_blk)
+        {
+            return false;
+        }
+    }
+
+    // What is left of the previous wilderness goes to the free list.
+    blk_meta *old = blka->wilderness;
+    if (old)
+    {
+        __blk_insert_to_free_list(blka, old);
+        old->checksum = blk_compute_checksum(old);
+    }
+
+    blka->wilderness = new_blk;
     new_blk->checksum = blk_compute_checksum(new_blk);
+    return true;
+}
+
+static blk_meta *blk_carve(blk_allocator *blka, size_t size)
+{
+    blk_meta *blk = blka->wilderness;
+    if ((!blk || blk->size < size) && !blk_grow_wilderness(blka, size))
+    {
+        return NULL;
+    }
+
+    blk = blka->wilderness;
+    blk_unretain(blka, blk);
+    blk_untrim(blka, blk);
+
+    // Bump: a single header is written after the block, the rest of the
+    // wilderness starts there.
+    if (blk->size >= size + sizeof(blk_meta) + MIN_DATA_SIZE)
+    {
+        blk_split(blk, size);
+        blka->wilderness = blk->next;
+        blka->wilderness->checksum = blk_compute_checksum(blka->wilderness);
+    }
+    else
+    {
+        blka->wilderness = NULL;
+    }
+
+    // Set current block as reserved.
+    blk->is_free = false;
+    blk->checksum = blk_compute_checksum(blk);
+    return blk;
 }
 
 void *blk_malloc(blk_allocator *blka, size_t size)
@@ -221,17 +620,26 @@ void *blk_malloc(blk_allocator *blka, size_t size)
     // Align the size.
     size_t aligned_size = blk_align_size(size);
 
-    // Check if all blocks are locked.
+    // Large requests get a span of their own without looking at the free
+    // list.
+    size_t threshold = blk_config_get()->mmap_threshold;
     blk_meta *best_blk = blka->free_list;
-    if (!best_blk)
+    if (threshold && aligned_size >= threshold)
     {
+        blk_latency_note(PATH_MMAP);
+
         // Extend allocator.
         blk_extend_allocator(blka, size);
         best_blk = blka->free_list;
+        if (!best_blk || best_blk->size < aligned_size)
+        {
+            return NULL;
+        }
     }
-    else
+    else if (best_blk)
     {
         // Find the best block (aka. closest size to aligned_size).
+        size_t steps = 1;
         blk_meta *blk = best_blk->next_free;
         while (blk)
         {
@@ -242,15 +650,17 @@ void *blk_malloc(blk_allocator *blka, size_t size)
             }
 
             blk = blk->next_free;
+            ++steps;
         }
 
-        // Check if we found a block with enough size.
-        if (best_blk->size < aligned_size)
-        {
-            // Extend allocator.
-            blk_extend_allocator(blka, size);
-            best_blk = blka->free_list;
-        }
+        BLK_PROBE3(free_list__search, blka, aligned_size, steps);
+    }
+
+    // Without a free block large enough, bump the wilderness.
+    if (!best_blk || best_blk->size < aligned_size)
+    {
+        blk_meta *blk = blk_carve(blka, aligned_size);
+        return blk ? BLK_TO_U8(blk) + sizeof(blk_meta) : NULL;
     }
 
     // Split the block if it is large enough.
@@ -304,11 +714,21 @@ void blk_free(blk_allocator *blka, void *ptr)
     // Mark the block as free.
     blk->is_free = true;
 
+    blk_release(blka, blk);
+}
+
+static void blk_release(blk_allocator *blka, blk_meta *blk)
+{
     // Try to merge.
     blk = blk_merge(blka, blk);
+    blk_untrim(blka, blk);
 
-    // Insert the new block into the free list.
-    __blk_insert_to_free_list(blka, blk);
+    // Insert the new block into the free list, unless it joined the
+    // wilderness.
+    if (blk != blka->wilderness)
+    {
+        __blk_insert_to_free_list(blka, blk);
+    }
 
     // Compute the checksum of the block.
     blk->checksum = blk_compute_checksum(blk);
@@ -316,6 +736,187 @@ void blk_free(blk_allocator *blka, void *ptr)
     blk_try_free_page(blka, blk);
 }
 
+size_t blk_malloc_batch(blk_allocator *blka, size_t size, size_t n,
+                        void **out)
+{
+    if (!n)
+    {
+        return 0;
+    }
+
+    // The blocks are carved one after the other from a single free block.
+    size_t aligned_size = blk_align_size(size);
+    size_t stride = aligned_size + sizeof(blk_meta);
+    size_t needed;
+    if (__builtin_mul_overflow(n, stride, &needed))
+    {
+        return 0;
+    }
+
+    needed -= sizeof(blk_meta);
+
+    // Find the smallest free block holding the whole batch.
+    blk_meta *best_blk = NULL;
+    for (blk_meta *blk = blka->free_list; blk; blk = blk->next_free)
+    {
+        if (blk->size >= needed && (!best_blk || blk->size < best_blk->size))
+        {
+            best_blk = blk;
+        }
+    }
+
+    if (best_blk)
+    {
+        // Remove the block from the free list.
+        blk_remove_from_free_list(blka, best_blk);
+    }
+    else
+    {
+        // Carve the whole batch from the wilderness.
+        best_blk = blk_carve(blka, needed);
+        if (!best_blk)
+        {
+            return 0;
+        }
+    }
+
+    // Write the headers in a single pass, the last block keeps the rest.
+    blk_meta *end = best_blk->next;
+    size_t remaining = best_blk->size;
+    blk_meta *blk = best_blk;
+    for (size_t i = 0; i < n; ++i)
+    {
+        blk->is_free = false;
+        out[i] = BLK_TO_U8(blk) + sizeof(blk_meta);
+        if (i + 1 == n)
+        {
+            break;
+        }
+
+        blk_meta *next = U8_TO_BLK(BLK_TO_U8(blk) + stride);
+        memset(next, 0, sizeof(blk_meta));
+        next->prev = blk;
+
+        blk->next = next;
+        blk->size = aligned_size;
+        blk->checksum = blk_compute_checksum(blk);
+
+        remaining -= stride;
+        blk = next;
+    }
+
+    blk->next = end;
+    blk->size = remaining;
+    if (end)
+    {
+        end->prev = blk;
+        end->checksum = blk_compute_checksum(end);
+    }
+
+    // Give back what is left after the last block.
+    if (blk->size >= aligned_size + sizeof(blk_meta) + MIN_DATA_SIZE)
+    {
+        blk_split(blk, aligned_size);
+
+        blk_meta *child = blk->next;
+        __blk_insert_to_free_list(blka, child);
+        child->checksum = blk_compute_checksum(child);
+    }
+
+    blk->checksum = blk_compute_checksum(blk);
+
+    return n;
+}
+
+static void blk_sift_down(void **ptrs, size_t root, size_t end)
+{
+    while (2 * root + 1 < end)
+    {
+        // Pick the child with the biggest address.
+        size_t child = 2 * root + 1;
+        if (child + 1 < end
+            && (uintptr_t)ptrs[child] < (uintptr_t)ptrs[child + 1])
+        {
+            ++child;
+        }
+
+        if ((uintptr_t)ptrs[root] >= (uintptr_t)ptrs[child])
+        {
+            return;
+        }
+
+        void *temp = ptrs[root];
+        ptrs[root] = ptrs[child];
+        ptrs[child] = temp;
+        root = child;
+    }
+}
+
+static void blk_sort_pointers(void **ptrs, size_t n)
+{
+    // Heapsort, it sorts in place without allocating.
+    for (size_t start = n / 2; start > 0; --start)
+    {
+        blk_sift_down(ptrs, start - 1, n);
+    }
+
+    for (size_t end = n; end > 1; --end)
+    {
+        // Move the biggest address at the end.
+        void *temp = ptrs[0];
+        ptrs[0] = ptrs[end - 1];
+        ptrs[end - 1] = temp;
+        blk_sift_down(ptrs, 0, end - 1);
+    }
+}
+
+void blk_free_batch(blk_allocator *blka, void **ptrs, size_t n)
+{
+    // Sorted by address, neighbours come one after the other.
+    blk_sort_pointers(ptrs, n);
+
+    // Grow a run of freed blocks as long as they are contiguous.
+    blk_meta *run = NULL;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!ptrs[i])
+        {
+            continue;
+        }
+
+        // Get the block header and check for block integrity.
+        blk_meta *blk = U8_TO_BLK((uint8_t *)ptrs[i] - sizeof(blk_meta));
+        if (blk->is_free || !blk_validate_checksum(blk))
+        {
+            continue;
+        }
+
+        if (run && run->next == blk)
+        {
+            // Absorb it, no list operation needed.
+            run->size += blk->size + sizeof(blk_meta);
+            run->next = blk->next;
+            run->next->prev = run;
+            run->next->checksum = blk_compute_checksum(run->next);
+            continue;
+        }
+
+        if (run)
+        {
+            blk_release(blka, run);
+        }
+
+        // Mark the block as free.
+        blk->is_free = true;
+        run = blk;
+    }
+
+    if (run)
+    {
+        blk_release(blka, run);
+    }
+}
+
 void *blk_calloc(blk_allocator *blka, size_t size)
 {
     // Call malloc.
@@ -326,16 +927,96 @@ void *blk_calloc(blk_allocator *blka, size_t size)
     }
 
     // Set all bytes of data to 0.
-    memset(ptr, 0, size);
+    blk_zero(ptr, size);
 
     // Return the data pointer.
     return ptr;
 }
 
+void *blk_memalign(blk_allocator *blka, size_t alignment, size_t size)
+{
+    // Room for the block and for a free block in front of it.
+    size_t aligned_size = blk_align_size(size);
+    size_t padded_size;
+    if (__builtin_add_overflow(aligned_size,
+                               alignment + sizeof(blk_meta) + MIN_DATA_SIZE,
+                               &padded_size))
+    {
+        return NULL;
+    }
+
+    uint8_t *ptr = blk_malloc(blka, padded_size);
+    if (!ptr)
+    {
+        return NULL;
+    }
+
+    blk_meta *blk = U8_TO_BLK(ptr - sizeof(blk_meta));
+
+    // Give the bytes before the aligned address back as a free block.
+    uintptr_t addr = (uintptr_t)ptr;
+    if (addr % alignment)
+    {
+        uintptr_t aligned = addr + sizeof(blk_meta) + MIN_DATA_SIZE;
+        aligned = (aligned + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        blk_split(blk, aligned - addr - sizeof(blk_meta));
+
+        blk_meta *front = blk;
+        blk = blk->next;
+        blk->is_free = false;
+        blk->checksum = blk_compute_checksum(blk);
+
+        front->is_free = true;
+        blk_release(blka, front);
+    }
+
+    // Give the bytes after the block back too.
+    if (blk->size >= aligned_size + sizeof(blk_meta) + MIN_DATA_SIZE)
+    {
+        blk_split(blk, aligned_size);
+        blk->checksum = blk_compute_checksum(blk);
+        blk_release(blka, blk->next);
+    }
+
+    uint8_t *temp = BLK_TO_U8(blk);
+    temp += sizeof(blk_meta);
+    return temp;
+}
+
+static void *__blk_merge_wilderness(blk_allocator *blka, blk_meta *blk,
+                                    void *ptr, size_t new_size)
+{
+    blk_meta *wilderness = blka->wilderness;
+    if (!wilderness || blk->next != wilderness)
+    {
+        return NULL;
+    }
+
+    // Carve what is missing from the wilderness, its header included.
+    size_t aligned_size = blk_align_size(new_size);
+    size_t size = aligned_size - blk->size;
+    size = size > sizeof(blk_meta) + MIN_DATA_SIZE ? size - sizeof(blk_meta)
+                                                   : MIN_DATA_SIZE;
+
+    // The block cannot move to a new span, only grow with its own.
+    if (wilderness->size < size && !blk_grow_in_place(blka, size))
+    {
+        return NULL;
+    }
+
+    blk_meta *next = blk_carve(blka, size);
+    blk->size += sizeof(blk_meta) + next->size;
+    blk->next = next->next;
+    blk->next->prev = blk;
+    blk->next->checksum = blk_compute_checksum(blk->next);
+    blk->checksum = blk_compute_checksum(blk);
+    return ptr;
+}
+
 static void *__blk_merge_next(blk_allocator *blka, blk_meta *blk, void *ptr,
                               size_t new_size)
 {
-    if (blk->next && blk->next->is_free)
+    if (blk->next && blk->next->is_free && blk->next != blka->wilderness)
     {
         size_t total_available = blk->size + blk->next->size + sizeof(blk_meta);
         if (total_available >= new_size)
@@ -344,7 +1025,10 @@ static void *__blk_merge_next(blk_allocator *blka, blk_meta *blk, void *ptr,
             blk->size = total_available;
             blk->next = blk->next->next;
             if (blk->next)
+            {
                 blk->next->prev = blk;
+                blk->next->checksum = blk_compute_checksum(blk->next);
+            }
             blk->checksum = blk_compute_checksum(blk);
             return ptr;
         }
@@ -358,13 +1042,26 @@ static void *__blk_merge_prev(blk_allocator *blka, blk_meta *blk,
     if (blk->prev && blk->prev->is_free
         && blk->prev->size + blk->size + sizeof(blk_meta) >= new_size)
     {
-        blk_remove_from_free_list(blka, blk);
         blk_meta *prev = blk->prev;
-        prev->size += blk->size + sizeof(blk_meta);
-        prev->next = blk->next;
-        if (blk->next)
-            blk->next->prev = prev;
-        return BLK_TO_U8(blk) + sizeof(blk_meta);
+        blk_meta *next = blk->next;
+        size_t size = blk->size;
+
+        // The previous block becomes the reserved one.
+        blk_remove_from_free_list(blka, prev);
+        prev->size += size + sizeof(blk_meta);
+        prev->next = next;
+        prev->is_free = false;
+        if (next)
+        {
+            next->prev = prev;
+            next->checksum = blk_compute_checksum(next);
+        }
+
+        // Move the data to the front, it may overwrite the old header.
+        uint8_t *data = BLK_TO_U8(prev) + sizeof(blk_meta);
+        memmove(data, BLK_TO_U8(blk) + sizeof(blk_meta), size);
+        prev->checksum = blk_compute_checksum(prev);
+        return data;
     }
     return NULL;
 }
@@ -379,6 +1076,8 @@ void *blk_realloc(blk_allocator *blka, void *ptr, size_t new_size)
         return ptr;
 
     void *merged_ptr;
+    if ((merged_ptr = __blk_merge_wilderness(blka, blk, ptr, new_size)))
+        return merged_ptr;
     if ((merged_ptr = __blk_merge_next(blka, blk, ptr, new_size)))
         return merged_ptr;
     if ((merged_ptr = __blk_merge_prev(blka, blk, new_size)))
@@ -388,7 +1087,7 @@ void *blk_realloc(blk_allocator *blka, void *ptr, size_t new_size)
     if (!new_ptr)
         return NULL;
 
-    memcpy(new_ptr, ptr, blk->size);
+    blk_copy(new_ptr, ptr, blk->size);
     blk_free(blka, ptr);
     ptr_p = new_ptr;
     blk = U8_TO_BLK(ptr_p - sizeof(blk_meta));
@@ -397,6 +1096,63 @@ void *blk_realloc(blk_allocator *blka, void *ptr, size_t new_size)
     return new_ptr;
 }
 
+static bool blk_trim_block(blk_allocator *blka, blk_meta *blk, size_t pad)
+{
+    // Skip blocks already trimmed or too small to hold the pad.
+    if (blk->is_trimmed || blk->size <= pad)
+    {
+        return false;
+    }
+
+    // Only release the pages fully covered by the block data, past its first
+    // word which keeps the number of bytes released.
+    size_t *trimmed = (void *)(BLK_TO_U8(blk) + sizeof(blk_meta));
+    size_t keep = pad > sizeof(size_t) ? pad : sizeof(size_t);
+    uintptr_t page_size = PAGE_SIZE;
+    uintptr_t start = (uintptr_t)trimmed + keep;
+    uintptr_t end = (uintptr_t)trimmed + blk->size;
+    start = (start + page_size - 1) & ~(page_size - 1);
+    end &= ~(page_size - 1);
+
+    // Not queued to the background thread like the unmapped spans: the block
+    // could be handed out before its pages are dropped, zeroing its data.
+    *trimmed = 0;
+    if (start < end)
+    {
+        void *addr = (void *)start;
+        if (madvise(addr, end - start, MADV_DONTNEED) == 0)
+        {
+            *trimmed = end - start;
+        }
+    }
+
+    // The pages no longer count against the budget until the block is used.
+    blka->trimmed += *trimmed;
+    blk_limit_uncharge(*trimmed);
+
+    // Remember it so the next pass does not issue the same syscall.
+    blk->is_trimmed = true;
+    blk->checksum = blk_compute_checksum(blk);
+    return *trimmed;
+}
+
+bool blk_trim(blk_allocator *blka, size_t pad)
+{
+    bool released = false;
+    for (blk_meta *blk = blka->free_list; blk; blk = blk->next_free)
+    {
+        released |= blk_trim_block(blka, blk, pad);
+    }
+
+    // The wilderness is not in the free list.
+    if (blka->wilderness)
+    {
+        released |= blk_trim_block(blka, blka->wilderness, pad);
+    }
+
+    return released;
+}
+
 static void blk_split(blk_meta *blk, size_t size)
 {
     // Create the new block.
@@ -441,6 +1197,7 @@ static blk_meta *blk_merge(blk_allocator *blka, blk_meta *blk)
         if (blk->next)
         {
             blk->next->prev = prev;
+            blk->next->checksum = blk_compute_checksum(blk->next);
         }
 
         // Update checksum for the merged previous block.
@@ -455,8 +1212,17 @@ static blk_meta *blk_merge(blk_allocator *blka, blk_meta *blk)
     {
         blk_meta *next = blk->next;
 
-        // Remove the next block from the free list before merging.
-        blk_remove_from_free_list(blka, next);
+        // Remove the next block from the free list before merging, the
+        // wilderness grows backwards instead.
+        if (next == blka->wilderness)
+        {
+            blk_untrim(blka, next);
+            blka->wilderness = blk;
+        }
+        else
+        {
+            blk_remove_from_free_list(blka, next);
+        }
 
         // Merge the next block into the current block.
         blk->size += next->size + sizeof(blk_meta);
@@ -465,6 +1231,7 @@ static blk_meta *blk_merge(blk_allocator *blka, blk_meta *blk)
         if (next->next)
         {
             next->next->prev = blk;
+            next->next->checksum = blk_compute_checksum(next->next);
         }
 
         // Update checksum for the merged current block.
@@ -475,8 +1242,18 @@ static blk_meta *blk_merge(blk_allocator *blka, blk_meta *blk)
     return blk;
 }
 
+void blk_set_checksums(bool enabled)
+{
+    checksums_enabled = enabled;
+}
+
 static uint32_t blk_compute_checksum(blk_meta *blk)
 {
+    if (!checksums_enabled)
+    {
+        return 0;
+    }
+
     // Add every fields except the checksum field.
     uint32_t checksum = 0;
     uint8_t *blk_p = BLK_TO_U8(blk);
@@ -490,6 +1267,11 @@ static uint32_t blk_compute_checksum(blk_meta *blk)
 
 bool blk_validate_checksum(blk_meta *blk)
 {
+    if (!checksums_enabled)
+    {
+        return true;
+    }
+
     // Compare actual and newly computed checksum.
     uint32_t current_checksum = blk_compute_checksum(blk);
     return current_checksum == blk->checksum;
@@ -521,4 +1303,30 @@ static void blk_remove_from_free_list(blk_allocator *blka, blk_meta *blk)
     // Detach blk from the free list.
     blk->next_free = NULL;
     blk->prev_free = NULL;
+
+    blk_unretain(blka, blk);
+    blk_untrim(blka, blk);
+}
+
+static void blk_unretain(blk_allocator *blka, blk_meta *blk)
+{
+    // A retained span is in use again.
+    if (blk->is_retained)
+    {
+        blk_span *span = U8_TO_SPAN(BLK_TO_U8(blk) - sizeof(blk_span));
+        blka->retained -= span->size;
+        blk->is_retained = false;
+    }
+}
+
+static void blk_untrim(blk_allocator *blka, blk_meta *blk)
+{
+    // The pages of a trimmed block count again once it may be written.
+    if (blk->is_trimmed)
+    {
+        size_t *trimmed = (void *)(BLK_TO_U8(blk) + sizeof(blk_meta));
+        blka->trimmed -= *trimmed;
+        blk_limit_recharge(*trimmed);
+        blk->is_trimmed = false;
+    }
 }
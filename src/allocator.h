@@ -1,19 +1,27 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
 
-#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include "lock.h"
+
 /// @brief Macro to get system page size.
 #define PAGE_SIZE sysconf(_SC_PAGE_SIZE)
 
 /// @brief Macro that define the minimum size of a block.
 #define MIN_DATA_SIZE sizeof(long double)
 
+/// @brief Macro that define the arena index of explicit heaps.
+#define HEAP_ARENA UINT8_MAX
+
+/// @brief Macro that define the largest growth of the wilderness, bigger
+/// requests still get a span of their size.
+#define WILDERNESS_MAX_GROWTH (32 * 1024 * 1024)
+
 /// @brief Macro that define mmap() protection flag.
 #define PROT_FLAGS (PROT_READ | PROT_WRITE)
 
@@ -37,51 +45,193 @@ struct blk_meta
     size_t size;
     size_t garbage;
     bool is_free;
+    bool is_trimmed;
+    bool is_retained;
 };
 
 typedef struct blk_meta blk_meta;
 
+// The first block follows the header, its size keeps the data aligned.
+struct __attribute__((aligned(MIN_DATA_SIZE))) blk_span
+{
+    // Double linked list of the mappings of an allocator
+    struct blk_span *next;
+    struct blk_span *prev;
+
+    // Span info
+    size_t size;
+    struct blk_allocator *owner;
+
+    // Mapped by blk_reserve(), kept once empty outside of the retain budget
+    bool is_reserved;
+};
+
+typedef struct blk_span blk_span;
+
+struct blk_span_cursor
+{
+    // Linked list of the walks over the spans of an allocator
+    struct blk_span_cursor *next;
+
+    // Next span to walk, moved on when it is unmapped, NULL at the end
+    struct blk_span *span;
+};
+
 struct blk_allocator
 {
     // Double linked lists
     struct blk_meta *meta;
     struct blk_meta *free_list;
 
+    // Free block at the end of a span, out of the free list, fresh blocks are
+    // carved from its front
+    struct blk_meta *wilderness;
+
+    // Mappings, in the same order as the pages of the normal list
+    struct blk_span *spans;
+    struct blk_span *last_span;
+
+    // Walks in progress, kept on a valid span while the lock is released
+    struct blk_span_cursor *cursors;
+
     // Allocator info
-    pthread_mutex_t lock;
+    blk_lock lock;
     size_t size;
+    size_t retained;
+    size_t reserved;
+
+    // Bytes given back by blk_trim(), not counted against the budget
+    size_t trimmed;
+
+    // Arena info
+    uint8_t id;
+    int node;
 };
 
 typedef struct blk_allocator blk_allocator;
 
-/// @brief Allocate a page and setup it.
+/// @brief Allocate a page, append its span to the allocator and setup it.
+/// @param blka The block allocator the page belongs to.
+/// @param size The size needed for this page.
+/// @return Return the address of the first block, NULL on failure.
+/// static void *blk_new_page(blk_allocator *blka, size_t size);
+
+/// @brief Allocate a page and link its first block after the last block of
+/// the allocator.
+/// @param blka The block allocator.
 /// @param size The size needed for this page.
-/// @return Return the address of the first block or the block allocator.
-/// static void *blk_new_page(size_t size);
+/// @return The first block, free and covering the whole span, NULL on
+/// failure. Its checksum is left to the caller.
+/// static blk_meta *blk_append_page(blk_allocator *blka, size_t size);
 
-/// @brief Align the size.
+/// @brief Write the first and the last block of a span.
+/// @param span The span.
+/// @return The first block, free and covering the whole span.
+/// static blk_meta *blk_setup_span(blk_span *span);
+
+/// @brief Unlink a span from the allocator and unmap it.
+/// @param blka The block allocator.
+/// @param span The span.
+/// static void blk_unmap_span(blk_allocator *blka, blk_span *span);
+
+/// @brief Align the size, inlined in the allocation paths.
 /// @param size The size value.
 /// @return The greatest multiple of sizeof(long double).
-/// static size_t blk_align_size(size_t size);
+static inline size_t blk_align_size(size_t size)
+{
+    // If this is already aligned, do nothing.
+    if (size % sizeof(long double) == 0)
+    {
+        return size;
+    }
+
+    // Calculate the padding to add.
+    size_t padding = sizeof(long double) - size % sizeof(long double);
+
+    // Check for an overflow.
+    size_t aligned_size;
+    if (__builtin_add_overflow(size, padding, &aligned_size))
+    {
+        // If it overflows, return SIZE_MAX.
+        return SIZE_MAX;
+    }
+
+    // Return the result.
+    return aligned_size;
+}
 
 /// @brief Initialize the allocator.
 /// @param size The size it should be able to hold directly.
 void blk_init_allocator(blk_allocator *blka, size_t size);
 
+/// @brief Initialize an allocator used as one arena among others.
+/// @param blka The block allocator.
+/// @param size The size it should be able to hold directly.
+/// @param id The arena index, HEAP_ARENA for explicit heaps.
+/// @param node The NUMA node its pages are bound to, -1 for none.
+void blk_init_arena(blk_allocator *blka, size_t size, uint8_t id, int node);
+
+/// @brief Map a span kept for the lifetime of the allocator, even once all
+/// its blocks are free, so later requests do not wait for mmap().
+/// @param blka The block allocator.
+/// @param size The size of the span.
+/// @param populate true to fault its pages in now.
+/// @return true if it succeeded, false otherwise.
+bool blk_reserve(blk_allocator *blka, size_t size, bool populate);
+
+/// @brief Unmap the spans kept mapped once all their blocks were freed,
+/// including the reserved ones, to get back under a memory limit.
+/// @param blka The block allocator.
+/// @return The number of bytes unmapped.
+size_t blk_release_retained(blk_allocator *blka);
+
 /// @brief Try to free the page of blk.
 /// @param blka The block allocator.
 /// @param blk The block.
 /// static void blk_try_free_page(blk_allocator *blka, blk_meta *blk);
 
-/// @brief Unmap the memory of the allocator. It should not be used afterwards.
+/// @brief Unlink a free block covering a whole span and unmap the span.
+/// @param blka The block allocator.
+/// @param blk The block.
+/// static void blk_unmap_page(blk_allocator *blka, blk_meta *blk);
+
+/// @brief Unmap the memory of the allocator, one span at a time. It should
+/// not be used afterwards.
 /// @param blka The block allocator to destroy.
 void blk_cleanup_allocator(blk_allocator *blka);
 
+/// @brief Drop every block of the allocator at once. The first span is kept
+/// as a single free block, the others are unmapped.
+/// @param blka The block allocator to reset.
+void blk_reset_allocator(blk_allocator *blka);
+
 /// @brief Extend the memory mapped to this allocator.
 /// @param blka The block allocator.
 /// @param size The size of the new block.
 /// static void blk_extend_allocator(blk_allocator *blka, size_t size);
 
+/// @brief Grow the span of the wilderness with mremap(), without moving it.
+/// @param blka The block allocator.
+/// @param size The size the wilderness should hold.
+/// @return true if it succeeded, false otherwise.
+/// static bool blk_grow_in_place(blk_allocator *blka, size_t size);
+
+/// @brief Make the wilderness hold size bytes, growing its span in place or
+/// mapping a new one. Each growth is as large as the memory already mapped,
+/// up to WILDERNESS_MAX_GROWTH, so a growing heap makes a logarithmic number
+/// of syscalls.
+/// @param blka The block allocator.
+/// @param size The size the wilderness should hold.
+/// @return true if it succeeded, false otherwise.
+/// static bool blk_grow_wilderness(blk_allocator *blka, size_t size);
+
+/// @brief Carve a block from the front of the wilderness, the rest of it
+/// stays the wilderness.
+/// @param blka The block allocator.
+/// @param size The aligned size of the block.
+/// @return The block, reserved, NULL on failure.
+/// static blk_meta *blk_carve(blk_allocator *blka, size_t size);
+
 /// @brief Allocate a block to the caller.
 /// @param blka The block allocator.
 /// @param size The size of the block.
@@ -93,12 +243,37 @@ void *blk_malloc(blk_allocator *blka, size_t size);
 /// @param ptr A pointer previously returned by blk_malloc(2).
 void blk_free(blk_allocator *blka, void *ptr);
 
+/// @brief Allocate n blocks of the same size, carved one after the other from
+/// a single free block.
+/// @param blka The block allocator.
+/// @param size The size of each block.
+/// @param n The number of blocks.
+/// @param out Array receiving the n data pointers.
+/// @return n if it succeeded, 0 otherwise.
+size_t blk_malloc_batch(blk_allocator *blka, size_t size, size_t n,
+                        void **out);
+
+/// @brief Free n blocks, merging contiguous ones in a single sweep.
+/// @param blka The block allocator.
+/// @param ptrs Pointers previously returned by blk_malloc(2), sorted by
+/// address by the call. NULL entries are skipped.
+/// @param n The number of pointers.
+void blk_free_batch(blk_allocator *blka, void **ptrs, size_t n);
+
 /// @brief Allocate a block to the caller. Set all bytes to 0.
 /// @param blka The block allocator.
 /// @param size The size of the block.
 /// @return A pointer to a region initialized to 0 where the caller can write.
 void *blk_calloc(blk_allocator *blka, size_t size);
 
+/// @brief Allocate a block whose data pointer is a multiple of alignment. The
+/// bytes skipped before it and the unused ones after it stay free blocks.
+/// @param blka The block allocator.
+/// @param alignment The alignment, a power of two.
+/// @param size The size of the block.
+/// @return A pointer to a region where the caller can write.
+void *blk_memalign(blk_allocator *blka, size_t alignment, size_t size);
+
 /// @brief Shrink or expand the block associated with ptr.
 /// @param blka The block allocator.
 /// @param ptr A pointer previously returned by blk_malloc(2).
@@ -106,6 +281,14 @@ void *blk_calloc(blk_allocator *blka, size_t size);
 /// @return A pointer to a region where the caller can write.
 void *blk_realloc(blk_allocator *blka, void *ptr, size_t new_size);
 
+/// @brief Give the whole pages inside free blocks back to the system. The
+/// headers stay mapped so the lists remain valid, the pages are uncharged
+/// from the budget until their block is used again.
+/// @param blka The block allocator.
+/// @param pad The number of bytes to keep after each header.
+/// @return true if some memory was released, false otherwise.
+bool blk_trim(blk_allocator *blka, size_t pad);
+
 /// @brief Split a block in two.
 /// @param blk The block to split.
 /// @param size The size of the first block.
@@ -124,12 +307,28 @@ void *blk_realloc(blk_allocator *blka, void *ptr, size_t new_size);
 
 /// @brief Validate the checksum of the block.
 /// @param blk The block to validate.
-/// @return True if it matches, false otherwise.
+/// @return True if it matches or checksums are disabled, false otherwise.
 bool blk_validate_checksum(blk_meta *blk);
 
+/// @brief Turn the checksums of every allocator on or off. They should only
+/// be turned back on before the first allocation.
+/// @param enabled true to compute and check them, false to skip them.
+void blk_set_checksums(bool enabled);
+
 /// @brief Remove the block from the free list.
 /// @param blka The block allocator.
 /// @param blk The block to remove.
 /// static void blk_remove_from_free_list(blk_allocator *blka, blk_meta *blk);
 
+/// @brief Count the span of a retained block as in use again.
+/// @param blka The block allocator.
+/// @param blk The first block of the span.
+/// static void blk_unretain(blk_allocator *blka, blk_meta *blk);
+
+/// @brief Charge the pages given back by blk_trim() inside a block again,
+/// before the block is used or merged.
+/// @param blka The block allocator.
+/// @param blk The block.
+/// static void blk_untrim(blk_allocator *blka, blk_meta *blk);
+
 #endif /* ! ALLOCATOR_H */
@@ -0,0 +1,237 @@
+#ifndef BLK_ALLOCATOR_HPP
+#define BLK_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+
+#include "libmalloc.h"
+
+namespace blk
+{
+#if defined(__cpp_lib_allocate_at_least)
+    using std::allocation_result;
+#else
+    /// @brief Result of allocate_at_least(), as in C++23.
+    template <class Pointer, class SizeType = std::size_t>
+    struct allocation_result
+    {
+        Pointer ptr;
+        SizeType count;
+    };
+#endif
+
+    namespace detail
+    {
+        /// @brief Alignment of every block of the allocator.
+        inline constexpr std::size_t block_alignment =
+            alignof(std::max_align_t);
+
+        /// @brief Allocate a region in a heap, over-aligned regions keep the
+        /// address of their block right before them.
+        /// @param heap The heap.
+        /// @param bytes The size of the region.
+        /// @param alignment The alignment of the region.
+        /// @return The region, throws std::bad_alloc on failure.
+        inline void *allocate(blk_heap *heap, std::size_t bytes,
+                              std::size_t alignment)
+        {
+            if (alignment <= block_alignment)
+            {
+                void *ptr = blk_heap_malloc(heap, bytes);
+                if (!ptr)
+                {
+                    throw std::bad_alloc();
+                }
+
+                return ptr;
+            }
+
+            if (bytes > SIZE_MAX - alignment)
+            {
+                throw std::bad_alloc();
+            }
+
+            void *block = blk_heap_malloc(heap, bytes + alignment);
+            if (!block)
+            {
+                throw std::bad_alloc();
+            }
+
+            // The gap is at least block_alignment bytes, enough for a pointer.
+            auto address = reinterpret_cast<std::uintptr_t>(block);
+            address = (address + alignment) & ~(alignment - 1);
+            void *ptr = reinterpret_cast<void *>(address);
+            static_cast<void **>(ptr)[-1] = block;
+            return ptr;
+        }
+
+        /// @brief Free a region returned by allocate().
+        /// @param heap The heap.
+        /// @param ptr The region.
+        /// @param alignment The alignment it was allocated with.
+        inline void deallocate(blk_heap *heap, void *ptr,
+                               std::size_t alignment) noexcept
+        {
+            if (alignment > block_alignment)
+            {
+                ptr = static_cast<void **>(ptr)[-1];
+            }
+
+            blk_heap_free(heap, ptr);
+        }
+
+        /// @brief Get the number of bytes usable in a region.
+        /// @param ptr The region.
+        /// @param alignment The alignment it was allocated with.
+        inline std::size_t usable_size(void *ptr,
+                                       std::size_t alignment) noexcept
+        {
+            if (alignment <= block_alignment)
+            {
+                return blk_usable_size(ptr);
+            }
+
+            void *block = static_cast<void **>(ptr)[-1];
+            return blk_usable_size(block)
+                - (static_cast<char *>(ptr) - static_cast<char *>(block));
+        }
+    } // namespace detail
+
+    /// @brief Memory resource owning an explicit heap. Blocks still allocated
+    /// when it is released or destroyed are dropped with the heap.
+    class heap_resource : public std::pmr::memory_resource
+    {
+    public:
+        /// @brief Create the heap.
+        /// @param size The size it should be able to hold directly.
+        explicit heap_resource(std::size_t size = 0)
+            : heap_(blk_heap_create(size))
+        {
+            if (!heap_)
+            {
+                throw std::bad_alloc();
+            }
+        }
+
+        heap_resource(const heap_resource &) = delete;
+        heap_resource &operator=(const heap_resource &) = delete;
+
+        ~heap_resource() override
+        {
+            blk_heap_destroy(heap_);
+        }
+
+        /// @brief Free every block of the heap at once, in O(pages).
+        void release() noexcept
+        {
+            blk_heap_reset(heap_);
+        }
+
+        /// @brief Get the heap, to be used with the C interface.
+        blk_heap *native_handle() const noexcept
+        {
+            return heap_;
+        }
+
+    protected:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            return detail::allocate(heap_, bytes, alignment);
+        }
+
+        void do_deallocate(void *ptr, std::size_t,
+                           std::size_t alignment) override
+        {
+            detail::deallocate(heap_, ptr, alignment);
+        }
+
+        bool do_is_equal(
+            const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    private:
+        blk_heap *heap_;
+    };
+
+    /// @brief STL allocator placing the objects in an explicit heap.
+    template <class T>
+    class allocator
+    {
+    public:
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        explicit allocator(blk_heap *heap) noexcept
+            : heap_(heap)
+        {}
+
+        explicit allocator(heap_resource &resource) noexcept
+            : heap_(resource.native_handle())
+        {}
+
+        template <class U>
+        allocator(const allocator<U> &other) noexcept
+            : heap_(other.heap())
+        {}
+
+        T *allocate(std::size_t n)
+        {
+            return static_cast<T *>(
+                detail::allocate(heap_, bytes(n), alignof(T)));
+        }
+
+        /// @brief Allocate room for at least n objects.
+        /// @return The region and the number of objects the block really
+        /// holds, so containers can use the slack of the block.
+        allocation_result<T *> allocate_at_least(std::size_t n)
+        {
+            void *ptr = detail::allocate(heap_, bytes(n), alignof(T));
+            return { static_cast<T *>(ptr),
+                     detail::usable_size(ptr, alignof(T)) / sizeof(T) };
+        }
+
+        void deallocate(T *ptr, std::size_t) noexcept
+        {
+            detail::deallocate(heap_, ptr, alignof(T));
+        }
+
+        blk_heap *heap() const noexcept
+        {
+            return heap_;
+        }
+
+        template <class U>
+        bool operator==(const allocator<U> &other) const noexcept
+        {
+            return heap_ == other.heap();
+        }
+
+        template <class U>
+        bool operator!=(const allocator<U> &other) const noexcept
+        {
+            return heap_ != other.heap();
+        }
+
+    private:
+        static std::size_t bytes(std::size_t n)
+        {
+            if (n > SIZE_MAX / sizeof(T))
+            {
+                throw std::bad_array_new_length();
+            }
+
+            return n * sizeof(T);
+        }
+
+        blk_heap *heap_;
+    };
+} // namespace blk
+
+#endif /* ! BLK_ALLOCATOR_HPP */
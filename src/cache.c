@@ -0,0 +1,853 @@
+#include "cache.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "config.h"
+#include "iterate.h"
+#include "limit.h"
+#include "pagemap.h"
+
+struct blk_cache_thread
+{
+    // Magazines of the thread, a slot per cache id
+    struct blk_cache_local locals[CACHE_THREAD_SLOTS];
+};
+
+// Magazines that are not in use, mapped together and never unmapped.
+static blk_cache_magazine *free_magazines;
+static blk_lock magazine_lock;
+
+// Guards the slots of every thread, taken when a slot changes cache.
+static blk_lock locals_lock;
+
+// Every cache, the walks find the next one from the id of the last.
+static blk_cache *caches;
+static blk_cache *last_cache;
+static blk_lock caches_lock;
+
+static uint32_t next_id;
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+static __thread struct blk_cache_thread *thread_slots
+    __attribute__((tls_model("initial-exec")));
+
+static blk_cache_magazine *blk_cache_new_magazine(void)
+{
+    blk_lock_acquire(&magazine_lock);
+
+    if (!free_magazines)
+    {
+        void *addr = mmap(NULL,
+                          CACHE_MAGAZINES_PER_MAP * sizeof(blk_cache_magazine),
+                          PROT_FLAGS, MAP_FLAGS, -1, 0);
+        if (addr == MAP_FAILED)
+        {
+            blk_lock_release(&magazine_lock);
+            return NULL;
+        }
+
+        blk_cache_magazine *magazines = addr;
+        for (size_t i = 0; i < CACHE_MAGAZINES_PER_MAP; ++i)
+        {
+            magazines[i].next = free_magazines;
+            free_magazines = &magazines[i];
+        }
+    }
+
+    blk_cache_magazine *magazine = free_magazines;
+    free_magazines = magazine->next;
+
+    blk_lock_release(&magazine_lock);
+
+    magazine->next = NULL;
+    magazine->rounds = 0;
+    return magazine;
+}
+
+static void blk_cache_delete_magazine(blk_cache_magazine *magazine)
+{
+    if (!magazine)
+    {
+        return;
+    }
+
+    blk_lock_acquire(&magazine_lock);
+    magazine->next = free_magazines;
+    free_magazines = magazine;
+    blk_lock_release(&magazine_lock);
+}
+
+static void blk_cache_link(blk_cache_slab **head, blk_cache_slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head)
+    {
+        (*head)->prev = slab;
+    }
+
+    *head = slab;
+}
+
+static void blk_cache_unlink(blk_cache_slab **head, blk_cache_slab *slab)
+{
+    if (slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *head = slab->next;
+    }
+
+    if (slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+}
+
+static blk_cache_slab *blk_cache_slab_create(blk_cache *cache)
+{
+    // Stay within the memory budget.
+    if (!blk_limit_charge(cache->slab_size))
+    {
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, cache->slab_size, PROT_FLAGS, MAP_FLAGS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        blk_limit_uncharge(cache->slab_size);
+        return NULL;
+    }
+
+    blk_config_advise(addr, cache->slab_size);
+
+    blk_cache_slab *slab = addr;
+    if (!blk_pagemap_set_cache(addr, cache->slab_size, slab))
+    {
+        blk_pagemap_set_cache(addr, cache->slab_size, NULL);
+        munmap(addr, cache->slab_size);
+        blk_limit_uncharge(cache->slab_size);
+        return NULL;
+    }
+
+    // Nothing is constructed yet, the slab counts as empty.
+    slab->cache = cache;
+    slab->objects = (uint8_t *)addr + cache->objects_offset;
+    slab->constructed = 0;
+    slab->free_count = 0;
+    slab->is_full = false;
+    blk_cache_link(&cache->partial, slab);
+    ++cache->empty_slabs;
+
+    return slab;
+}
+
+static void blk_cache_slab_destroy(blk_cache_slab *slab)
+{
+    blk_cache *cache = slab->cache;
+
+    // Only the free objects are known to be constructed.
+    if (cache->dtor)
+    {
+        for (uint32_t i = 0; i < slab->free_count; ++i)
+        {
+            cache->dtor(slab->objects + slab->free_stack[i] * cache->stride);
+        }
+    }
+
+    size_t slab_size = cache->slab_size;
+    blk_pagemap_set_cache(slab, slab_size, NULL);
+    munmap(slab, slab_size);
+    blk_limit_uncharge(slab_size);
+}
+
+static void blk_cache_destroy_slabs(blk_cache_slab *doomed)
+{
+    while (doomed)
+    {
+        blk_cache_slab *next = doomed->next;
+        blk_cache_slab_destroy(doomed);
+        doomed = next;
+    }
+}
+
+static size_t blk_cache_take(blk_cache *cache, void **out, size_t n,
+                             size_t *fresh)
+{
+    size_t count = 0;
+    *fresh = 0;
+
+    while (count + *fresh < n)
+    {
+        blk_cache_slab *slab = cache->partial;
+        if (!slab && !(slab = blk_cache_slab_create(cache)))
+        {
+            break;
+        }
+
+        if (slab->free_count == slab->constructed)
+        {
+            --cache->empty_slabs;
+        }
+
+        // Constructed objects first, then the ones never handed out.
+        while (count + *fresh < n && slab->free_count)
+        {
+            uint32_t index = slab->free_stack[--slab->free_count];
+            out[count++] = slab->objects + index * cache->stride;
+        }
+
+        while (count + *fresh < n && slab->constructed < cache->capacity)
+        {
+            uint32_t index = slab->constructed++;
+            out[n - ++*fresh] = slab->objects + index * cache->stride;
+        }
+
+        if (!slab->free_count && slab->constructed == cache->capacity)
+        {
+            blk_cache_unlink(&cache->partial, slab);
+            blk_cache_link(&cache->full, slab);
+            slab->is_full = true;
+        }
+    }
+
+    // Move the fresh objects right after the constructed ones.
+    memmove(out + count, out + n - *fresh, *fresh * sizeof(void *));
+    return count + *fresh;
+}
+
+static void blk_cache_put(blk_cache *cache, void **objects, size_t n,
+                          blk_cache_slab **doomed)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        // Pointers that are not a handed out object of the cache are ignored.
+        uint8_t *object = objects[i];
+        blk_cache_slab *slab = blk_cache_slab_of(object);
+        if (!slab || slab->cache != cache || object < slab->objects)
+        {
+            continue;
+        }
+
+        size_t offset = object - slab->objects;
+        size_t index = offset / cache->stride;
+        if (offset % cache->stride || index >= slab->constructed
+            || slab->free_count >= slab->constructed)
+        {
+            continue;
+        }
+
+        slab->free_stack[slab->free_count++] = index;
+
+        if (slab->is_full)
+        {
+            blk_cache_unlink(&cache->full, slab);
+            blk_cache_link(&cache->partial, slab);
+            slab->is_full = false;
+        }
+
+        // Keep a single empty slab, unless the caller keeps them all.
+        if (slab->free_count == slab->constructed && ++cache->empty_slabs > 1
+            && doomed)
+        {
+            blk_cache_unlink(&cache->partial, slab);
+            --cache->empty_slabs;
+            slab->next = *doomed;
+            *doomed = slab;
+        }
+    }
+}
+
+static void blk_cache_detach(blk_cache_local *local)
+{
+    blk_cache *cache = local->cache;
+
+    // Lock the cache.
+    blk_lock_acquire(&cache->lock);
+
+    // Call blk_cache_put, keeping the empty slabs as the cache may be going.
+    blk_cache_magazine *magazines[2] = { local->loaded, local->previous };
+    for (int i = 0; i < 2; ++i)
+    {
+        if (magazines[i])
+        {
+            blk_cache_put(cache, magazines[i]->objects, magazines[i]->rounds,
+                          NULL);
+        }
+    }
+
+    // Unlock the cache.
+    blk_lock_release(&cache->lock);
+
+    blk_cache_delete_magazine(local->loaded);
+    blk_cache_delete_magazine(local->previous);
+
+    if (local->prev)
+    {
+        local->prev->next = local->next;
+    }
+    else
+    {
+        cache->locals = local->next;
+    }
+
+    if (local->next)
+    {
+        local->next->prev = local->prev;
+    }
+
+    local->cache = NULL;
+    local->loaded = NULL;
+    local->previous = NULL;
+}
+
+static void blk_cache_thread_exit(void *arg)
+{
+    struct blk_cache_thread *slots = arg;
+
+    // Lock the thread slots.
+    blk_lock_acquire(&locals_lock);
+
+    // Call blk_cache_detach.
+    for (size_t i = 0; i < CACHE_THREAD_SLOTS; ++i)
+    {
+        if (slots->locals[i].cache)
+        {
+            blk_cache_detach(&slots->locals[i]);
+        }
+    }
+
+    // Unlock the thread slots.
+    blk_lock_release(&locals_lock);
+
+    thread_slots = NULL;
+    munmap(slots, sizeof(struct blk_cache_thread));
+}
+
+static void blk_cache_init(void)
+{
+    blk_lock_init(&magazine_lock);
+    blk_lock_init(&locals_lock);
+    blk_lock_init(&caches_lock);
+    pthread_key_create(&thread_key, blk_cache_thread_exit);
+}
+
+static blk_cache_local *blk_cache_attach(blk_cache *cache)
+{
+    struct blk_cache_thread *slots = thread_slots;
+    if (!slots)
+    {
+        void *addr = mmap(NULL, sizeof(struct blk_cache_thread), PROT_FLAGS,
+                          MAP_FLAGS, -1, 0);
+        if (addr == MAP_FAILED)
+        {
+            return NULL;
+        }
+
+        // Give the magazines back when the thread exits.
+        slots = addr;
+        thread_slots = slots;
+        pthread_setspecific(thread_key, slots);
+    }
+
+    blk_cache_local *local = &slots->locals[cache->id % CACHE_THREAD_SLOTS];
+
+    // Lock the thread slots.
+    blk_lock_acquire(&locals_lock);
+
+    // Call blk_cache_detach, for the cache that had the slot.
+    if (local->cache)
+    {
+        blk_cache_detach(local);
+    }
+
+    local->cache = cache;
+    local->prev = NULL;
+    local->next = cache->locals;
+    if (cache->locals)
+    {
+        cache->locals->prev = local;
+    }
+
+    cache->locals = local;
+
+    // Unlock the thread slots.
+    blk_lock_release(&locals_lock);
+
+    return local;
+}
+
+static inline blk_cache_local *blk_cache_local_of(blk_cache *cache)
+{
+    struct blk_cache_thread *slots = thread_slots;
+    if (slots)
+    {
+        blk_cache_local *local = &slots->locals[cache->id % CACHE_THREAD_SLOTS];
+        if (local->cache == cache)
+        {
+            return local;
+        }
+    }
+
+    return blk_cache_attach(cache);
+}
+
+blk_cache_slab *blk_cache_slab_of(const void *ptr)
+{
+    return blk_pagemap_get_cache(ptr);
+}
+
+__attribute__((visibility("default"))) blk_cache *
+blk_cache_create(size_t size, size_t align, blk_cache_callback ctor,
+                 blk_cache_callback dtor)
+{
+    pthread_once(&cache_once, blk_cache_init);
+
+    size_t page_size = PAGE_SIZE;
+    if (!align)
+    {
+        align = MIN_DATA_SIZE;
+    }
+
+    if (!size || align & (align - 1) || align > page_size
+        || size > SIZE_MAX / 2 / CACHE_MIN_OBJECTS)
+    {
+        return NULL;
+    }
+
+    // Objects follow each other, each of them aligned.
+    size_t stride = (size + align - 1) & ~(align - 1);
+
+    // Larger objects get larger slabs, to hold a few of them at least.
+    size_t slab_size = CACHE_SLAB_SIZE;
+    size_t needed = sizeof(blk_cache_slab) + align
+                    + CACHE_MIN_OBJECTS * (stride + sizeof(uint32_t));
+    if (needed > slab_size)
+    {
+        slab_size = (needed + page_size - 1) & ~(page_size - 1);
+    }
+
+    // The header, its free stack, then the objects.
+    size_t capacity = (slab_size - sizeof(blk_cache_slab) - align)
+                      / (stride + sizeof(uint32_t));
+    if (capacity > UINT32_MAX)
+    {
+        capacity = UINT32_MAX;
+    }
+
+    size_t offset = sizeof(blk_cache_slab) + capacity * sizeof(uint32_t);
+    offset = (offset + align - 1) & ~(align - 1);
+
+    void *addr = mmap(NULL, page_size, PROT_FLAGS, MAP_FLAGS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    blk_cache *cache = addr;
+    cache->size = size;
+    cache->stride = stride;
+    cache->ctor = ctor;
+    cache->dtor = dtor;
+    cache->slab_size = slab_size;
+    cache->objects_offset = offset;
+    cache->capacity = capacity;
+    blk_lock_init(&cache->lock);
+
+    // Lock the caches.
+    blk_lock_acquire(&caches_lock);
+
+    // Append the cache, the ids growing along the list.
+    cache->id = next_id++;
+    cache->next = NULL;
+    cache->prev = last_cache;
+    if (last_cache)
+    {
+        last_cache->next = cache;
+    }
+    else
+    {
+        caches = cache;
+    }
+
+    last_cache = cache;
+
+    // Unlock the caches.
+    blk_lock_release(&caches_lock);
+
+    return cache;
+}
+
+static void *blk_cache_alloc_slow(blk_cache *cache, blk_cache_local *local)
+{
+    blk_cache_magazine *loaded = NULL;
+    if (local)
+    {
+        // The previous magazine holds the objects freed before the last swap.
+        blk_cache_magazine *previous = local->previous;
+        if (previous && previous->rounds)
+        {
+            local->previous = local->loaded;
+            local->loaded = previous;
+            return previous->objects[--previous->rounds];
+        }
+
+        if (!local->loaded)
+        {
+            local->loaded = blk_cache_new_magazine();
+        }
+
+        loaded = local->loaded;
+    }
+
+    // Lock the cache.
+    blk_lock_acquire(&cache->lock);
+
+    // Swap the empty magazines for a full one of the depot.
+    blk_cache_magazine *full = cache->magazines;
+    if (loaded && full)
+    {
+        cache->magazines = full->next;
+        --cache->magazine_count;
+
+        // Unlock the cache.
+        blk_lock_release(&cache->lock);
+
+        blk_cache_delete_magazine(local->previous);
+        local->previous = loaded;
+        local->loaded = full;
+        return full->objects[--full->rounds];
+    }
+
+    // Call blk_cache_take, for half a magazine at once.
+    void *objects[CACHE_MAGAZINE_SIZE];
+    size_t fresh;
+    size_t count =
+        blk_cache_take(cache, objects, loaded ? CACHE_MAGAZINE_SIZE / 2 : 1,
+                       &fresh);
+
+    // Unlock the cache.
+    blk_lock_release(&cache->lock);
+
+    // Construct the objects never handed out, without the lock.
+    if (cache->ctor)
+    {
+        for (size_t i = count - fresh; i < count; ++i)
+        {
+            cache->ctor(objects[i]);
+        }
+    }
+
+    if (!count)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 1; i < count; ++i)
+    {
+        loaded->objects[loaded->rounds++] = objects[i];
+    }
+
+    return objects[0];
+}
+
+__attribute__((visibility("default"))) void *blk_cache_alloc(blk_cache *cache)
+{
+    blk_cache_local *local = blk_cache_local_of(cache);
+    blk_cache_magazine *loaded = local ? local->loaded : NULL;
+
+    // Constructed already, and taken without any lock.
+    if (loaded && loaded->rounds)
+    {
+        return loaded->objects[--loaded->rounds];
+    }
+
+    return blk_cache_alloc_slow(cache, local);
+}
+
+static void blk_cache_free_slow(blk_cache *cache, blk_cache_local *local,
+                                void *object)
+{
+    blk_cache_magazine *empty = NULL;
+    if (local)
+    {
+        // An empty previous magazine takes the place of the full one.
+        blk_cache_magazine *previous = local->previous;
+        if (previous && !previous->rounds)
+        {
+            local->previous = local->loaded;
+            local->loaded = previous;
+            previous->objects[previous->rounds++] = object;
+            return;
+        }
+
+        empty = blk_cache_new_magazine();
+        if (empty && !local->loaded)
+        {
+            local->loaded = empty;
+            empty->objects[empty->rounds++] = object;
+            return;
+        }
+    }
+
+    blk_cache_magazine *spare = NULL;
+    blk_cache_slab *doomed = NULL;
+
+    // Lock the cache.
+    blk_lock_acquire(&cache->lock);
+
+    if (empty)
+    {
+        // The full previous magazine goes to the depot, or back to the slabs
+        // once the depot holds enough.
+        blk_cache_magazine *full = local->previous;
+        if (full && cache->magazine_count < CACHE_DEPOT_MAGAZINES)
+        {
+            full->next = cache->magazines;
+            cache->magazines = full;
+            ++cache->magazine_count;
+        }
+        else if (full)
+        {
+            blk_cache_put(cache, full->objects, full->rounds, &doomed);
+            spare = full;
+        }
+
+        local->previous = local->loaded;
+        local->loaded = empty;
+        empty->objects[empty->rounds++] = object;
+    }
+    else
+    {
+        // Call blk_cache_put, without any magazine to fill.
+        blk_cache_put(cache, &object, 1, &doomed);
+    }
+
+    // Unlock the cache.
+    blk_lock_release(&cache->lock);
+
+    blk_cache_delete_magazine(spare);
+    blk_cache_destroy_slabs(doomed);
+}
+
+__attribute__((visibility("default"))) void blk_cache_free(blk_cache *cache,
+                                                           void *object)
+{
+    if (!object)
+    {
+        return;
+    }
+
+    blk_cache_local *local = blk_cache_local_of(cache);
+    blk_cache_magazine *loaded = local ? local->loaded : NULL;
+
+    // Kept constructed, and stored without any lock.
+    if (loaded && loaded->rounds < CACHE_MAGAZINE_SIZE)
+    {
+        loaded->objects[loaded->rounds++] = object;
+        return;
+    }
+
+    blk_cache_free_slow(cache, local, object);
+}
+
+__attribute__((visibility("default"))) void blk_cache_destroy(blk_cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    // Lock the thread slots.
+    blk_lock_acquire(&locals_lock);
+
+    // Call blk_cache_detach, for every thread with magazines of the cache.
+    while (cache->locals)
+    {
+        blk_cache_detach(cache->locals);
+    }
+
+    // Lock the caches.
+    blk_lock_acquire(&caches_lock);
+
+    // Unlink the cache, a walk holding the thread slots is done with it.
+    if (cache->prev)
+    {
+        cache->prev->next = cache->next;
+    }
+    else
+    {
+        caches = cache->next;
+    }
+
+    if (cache->next)
+    {
+        cache->next->prev = cache->prev;
+    }
+    else
+    {
+        last_cache = cache->prev;
+    }
+
+    // Unlock the caches.
+    blk_lock_release(&caches_lock);
+
+    // Unlock the thread slots.
+    blk_lock_release(&locals_lock);
+
+    while (cache->magazines)
+    {
+        blk_cache_magazine *magazine = cache->magazines;
+        cache->magazines = magazine->next;
+        blk_cache_put(cache, magazine->objects, magazine->rounds, NULL);
+        blk_cache_delete_magazine(magazine);
+    }
+
+    // Destruct the free objects, then unmap every slab and the cache.
+    blk_cache_slab *lists[2] = { cache->partial, cache->full };
+    for (int i = 0; i < 2; ++i)
+    {
+        while (lists[i])
+        {
+            blk_cache_slab *next = lists[i]->next;
+            blk_cache_slab_destroy(lists[i]);
+            lists[i] = next;
+        }
+    }
+
+    munmap(cache, PAGE_SIZE);
+}
+
+static bool blk_cache_record_slab(blk_cache *cache, blk_cache_slab *slab,
+                                  struct blk_iterate_buffer *buffer)
+{
+    size_t first = buffer->count;
+    for (uint32_t i = 0; i < slab->constructed; ++i)
+    {
+        if (!blk_iterate_add(buffer, slab->objects + i * cache->stride,
+                             cache->size, true))
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < slab->free_count; ++i)
+    {
+        buffer->records[first + slab->free_stack[i]].used = false;
+    }
+
+    return true;
+}
+
+static void blk_cache_record_magazine(const blk_cache_magazine *magazine,
+                                      struct blk_iterate_buffer *buffer)
+{
+    if (!magazine)
+    {
+        return;
+    }
+
+    uint32_t rounds = __atomic_load_n(&magazine->rounds, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < rounds && i < CACHE_MAGAZINE_SIZE; ++i)
+    {
+        blk_iterate_set_free(buffer, magazine->objects[i]);
+    }
+}
+
+static bool blk_cache_record(blk_cache *cache,
+                             struct blk_iterate_buffer *buffer)
+{
+    bool recorded = true;
+
+    // Lock the cache.
+    blk_lock_acquire(&cache->lock);
+
+    // Call blk_cache_record_slab, on the partial then the full slabs.
+    blk_cache_slab *lists[2] = { cache->partial, cache->full };
+    for (int i = 0; i < 2; ++i)
+    {
+        for (blk_cache_slab *slab = lists[i]; slab && recorded;
+             slab = slab->next)
+        {
+            recorded = blk_cache_record_slab(cache, slab, buffer);
+        }
+    }
+
+    // The objects of the depot and of the threads are free, the magazines
+    // of the threads change under their feet but are never unmapped.
+    if (recorded)
+    {
+        blk_iterate_sort(buffer);
+        for (blk_cache_magazine *magazine = cache->magazines; magazine;
+             magazine = magazine->next)
+        {
+            blk_cache_record_magazine(magazine, buffer);
+        }
+
+        for (blk_cache_local *local = cache->locals; local; local = local->next)
+        {
+            blk_cache_record_magazine(
+                __atomic_load_n(&local->loaded, __ATOMIC_RELAXED), buffer);
+            blk_cache_record_magazine(
+                __atomic_load_n(&local->previous, __ATOMIC_RELAXED), buffer);
+        }
+    }
+
+    // Unlock the cache.
+    blk_lock_release(&cache->lock);
+
+    return recorded;
+}
+
+bool blk_cache_iterate(blk_iterate_callback callback, void *arg)
+{
+    pthread_once(&cache_once, blk_cache_init);
+
+    struct blk_iterate_buffer buffer = { NULL, 0, 0 };
+    uint32_t id = 0;
+    bool walked = true;
+
+    while (walked)
+    {
+        // Lock the thread slots, a cache is not destroyed while they are held.
+        blk_lock_acquire(&locals_lock);
+
+        // Lock the caches.
+        blk_lock_acquire(&caches_lock);
+
+        // The cache following the last one walked, caches are few.
+        blk_cache *cache = caches;
+        while (cache && cache->id < id)
+        {
+            cache = cache->next;
+        }
+
+        // Unlock the caches.
+        blk_lock_release(&caches_lock);
+
+        // Call blk_cache_record.
+        if (cache)
+        {
+            id = cache->id + 1;
+            walked = blk_cache_record(cache, &buffer);
+        }
+
+        // Unlock the thread slots.
+        blk_lock_release(&locals_lock);
+
+        if (!cache || !walked)
+        {
+            break;
+        }
+
+        blk_iterate_flush(&buffer, callback, arg);
+    }
+
+    blk_iterate_unmap(&buffer);
+    return walked;
+}
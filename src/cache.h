@@ -0,0 +1,170 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "allocator.h"
+#include "libmalloc.h"
+
+/// @brief Macro that define the smallest mapping of a slab.
+#define CACHE_SLAB_SIZE (64 * 1024)
+
+/// @brief Macro that define the fewest objects of a slab, larger objects get
+/// larger slabs.
+#define CACHE_MIN_OBJECTS 8
+
+/// @brief Macro that define the number of objects held by a magazine.
+#define CACHE_MAGAZINE_SIZE 32
+
+/// @brief Macro that define the most full magazines kept by a cache, the
+/// objects of the next ones go back to their slabs.
+#define CACHE_DEPOT_MAGAZINES 16
+
+/// @brief Macro that define the number of magazines mapped at once.
+#define CACHE_MAGAZINES_PER_MAP 64
+
+/// @brief Macro that define the number of caches a thread keeps magazines
+/// for at once, caches with the same slot take it over from each other.
+#define CACHE_THREAD_SLOTS 32
+
+struct blk_cache_magazine
+{
+    // Linked list of the depot of a cache, or of the unused magazines
+    struct blk_cache_magazine *next;
+
+    // Constructed objects, the last one is handed out first
+    uint32_t rounds;
+    void *objects[CACHE_MAGAZINE_SIZE];
+};
+
+typedef struct blk_cache_magazine blk_cache_magazine;
+
+struct blk_cache_local
+{
+    // Double linked list of the threads holding magazines of the cache
+    struct blk_cache_local *next;
+    struct blk_cache_local *prev;
+
+    // Cache of the slot, NULL if none
+    struct blk_cache *cache;
+
+    // Magazines of the thread, the loaded one is used first
+    struct blk_cache_magazine *loaded;
+    struct blk_cache_magazine *previous;
+};
+
+typedef struct blk_cache_local blk_cache_local;
+
+struct blk_cache_slab
+{
+    // Double linked list of the partial or full slabs of a cache
+    struct blk_cache_slab *next;
+    struct blk_cache_slab *prev;
+
+    // Slab info
+    struct blk_cache *cache;
+    uint8_t *objects;
+    uint32_t constructed;
+    uint32_t free_count;
+    bool is_full;
+
+    // Indices of the constructed objects that are free, the objects from
+    // constructed on were never handed out
+    uint32_t free_stack[];
+};
+
+typedef struct blk_cache_slab blk_cache_slab;
+
+struct blk_cache
+{
+    // Objects info
+    size_t size;
+    size_t stride;
+    blk_cache_callback ctor;
+    blk_cache_callback dtor;
+    uint32_t id;
+
+    // Slabs info
+    size_t slab_size;
+    size_t objects_offset;
+    uint32_t capacity;
+
+    // Slabs with objects left first, and the count of the unused ones
+    blk_lock lock;
+    struct blk_cache_slab *partial;
+    struct blk_cache_slab *full;
+    size_t empty_slabs;
+
+    // Depot of full magazines
+    struct blk_cache_magazine *magazines;
+    size_t magazine_count;
+
+    // Threads with magazines, under the lock of the thread slots
+    struct blk_cache_local *locals;
+
+    // Double linked list of every cache in the order of the ids, under the
+    // lock of the list
+    struct blk_cache *next;
+    struct blk_cache *prev;
+};
+
+/// @brief Find the slab holding an object of a cache, without any lock.
+/// @param ptr The object.
+/// @return The slab, NULL if ptr is not in an object cache.
+blk_cache_slab *blk_cache_slab_of(const void *ptr);
+
+/// @brief Take objects from the slabs of a cache, mapping new slabs when
+/// needed. The cache lock must be held.
+/// @param cache The cache.
+/// @param out Receive the objects.
+/// @param n The number of objects wanted.
+/// @param fresh Receive the number of objects, at the end of out, to be
+/// constructed.
+/// @return The number of objects taken, less than n if out of memory.
+/// static size_t blk_cache_take(blk_cache *cache, void **out, size_t n,
+///                              size_t *fresh);
+
+/// @brief Give objects back to their slabs. The cache lock must be held. The
+/// empty slabs past the first one are unlinked and added to doomed, to be
+/// destroyed without the lock.
+/// @param cache The cache.
+/// @param objects The objects.
+/// @param n The number of objects.
+/// @param doomed List receiving the slabs to destroy.
+/// static void blk_cache_put(blk_cache *cache, void **objects, size_t n,
+///                           blk_cache_slab **doomed);
+
+/// @brief Record the objects a slab handed out at least once, those on its
+/// free stack as free. The cache lock must be held.
+/// @param cache The cache.
+/// @param slab The slab.
+/// @param buffer The buffer receiving the records.
+/// @return true if it succeeded, false if the buffer could not grow.
+/// static bool blk_cache_record_slab(blk_cache *cache, blk_cache_slab *slab,
+///                                   struct blk_iterate_buffer *buffer);
+
+/// @brief Mark the objects of a magazine as free, in the sorted records of
+/// its cache.
+/// @param magazine The magazine, NULL for none.
+/// @param buffer The buffer holding the records.
+/// static void blk_cache_record_magazine(const blk_cache_magazine *magazine,
+///                                       struct blk_iterate_buffer *buffer);
+
+/// @brief Record the objects of every slab of a cache, the ones in the
+/// magazines as free. The lock of the thread slots must be held, the cache
+/// lock is taken.
+/// @param cache The cache.
+/// @param buffer The buffer receiving the records.
+/// @return true if it succeeded, false if the buffer could not grow.
+/// static bool blk_cache_record(blk_cache *cache,
+///                              struct blk_iterate_buffer *buffer);
+
+/// @brief Call a callback on the objects of every cache, cache by cache. A
+/// cache is only locked while its objects are recorded. The objects never
+/// handed out are not reported, and the magazines of the threads are read
+/// without stopping them, so an object moving in or out of one meanwhile may
+/// be reported on either side.
+/// @param callback The callback.
+/// @param arg Passed to the callback.
+/// @return true if every cache was walked, false if out of memory.
+bool blk_cache_iterate(blk_iterate_callback callback, void *arg);
+
+#endif /* ! CACHE_H */
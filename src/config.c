@@ -0,0 +1,344 @@
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "copy.h"
+#include "percpu.h"
+
+enum blk_option_type
+{
+    OPTION_SIZE,
+    OPTION_BOOL,
+    OPTION_CHOICE,
+};
+
+struct blk_option
+{
+    const char *name;
+    enum blk_option_type type;
+    size_t offset;
+
+    // Names of the values of a choice, in the order of its enum
+    const char *const *choices;
+};
+
+static const char *const integrity_names[] = { "none", "checksum", NULL };
+static const char *const huge_pages_names[] = { "default", "always", "never",
+                                                NULL };
+
+static const struct blk_option options[] = {
+    { "arenas", OPTION_SIZE, offsetof(blk_config, arenas), NULL },
+    { "mmap_threshold", OPTION_SIZE, offsetof(blk_config, mmap_threshold),
+      NULL },
+    { "retain", OPTION_SIZE, offsetof(blk_config, retain), NULL },
+    { "async_release", OPTION_BOOL, offsetof(blk_config, async_release),
+      NULL },
+    { "memory_limit", OPTION_SIZE, offsetof(blk_config, memory_limit), NULL },
+    { "limit_interval", OPTION_SIZE, offsetof(blk_config, limit_interval),
+      NULL },
+    { "reserve", OPTION_SIZE, offsetof(blk_config, reserve), NULL },
+    { "populate", OPTION_BOOL, offsetof(blk_config, populate), NULL },
+    { "warm_caches", OPTION_BOOL, offsetof(blk_config, warm_caches), NULL },
+    { "huge_pages", OPTION_CHOICE, offsetof(blk_config, huge_pages),
+      huge_pages_names },
+    { "integrity", OPTION_CHOICE, offsetof(blk_config, integrity),
+      integrity_names },
+    { "stats", OPTION_BOOL, offsetof(blk_config, stats), NULL },
+    { "latency", OPTION_BOOL, offsetof(blk_config, latency), NULL },
+    { "latency_signal", OPTION_SIZE, offsetof(blk_config, latency_signal),
+      NULL },
+    { "nt_threshold", OPTION_SIZE, offsetof(blk_config, nt_threshold), NULL },
+    { "percpu_slots", OPTION_SIZE, offsetof(blk_config, percpu_slots), NULL },
+    { "slab", OPTION_BOOL, offsetof(blk_config, slab), NULL },
+    { "trim_interval", OPTION_SIZE, offsetof(blk_config, trim_interval),
+      NULL },
+    { "guard_rate", OPTION_SIZE, offsetof(blk_config, guard_rate), NULL },
+    { "guard_slots", OPTION_SIZE, offsetof(blk_config, guard_slots), NULL },
+    { "print", OPTION_BOOL, offsetof(blk_config, print), NULL },
+};
+
+static blk_config config = {
+    .arenas = 0,
+    .mmap_threshold = 0,
+    .retain = 0,
+    .huge_pages = HUGE_PAGES_DEFAULT,
+    .async_release = false,
+    .memory_limit = 0,
+    .limit_interval = 0,
+    .reserve = 0,
+    .populate = false,
+    .warm_caches = false,
+    .integrity = INTEGRITY_CHECKSUM,
+    .stats = true,
+    .latency = false,
+    .latency_signal = 0,
+    .nt_threshold = COPY_NT_THRESHOLD,
+    .percpu_slots = PERCPU_SLOTS,
+    .slab = false,
+    .trim_interval = 0,
+    .guard_rate = 0,
+    .guard_slots = GUARD_DEFAULT_SLOTS,
+    .print = false,
+};
+
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+
+static void blk_config_write(int fd, const char *str, size_t length)
+{
+    ssize_t ret = write(fd, str, length);
+    (void)ret;
+}
+
+static bool blk_config_match(const char *str, size_t length, const char *name)
+{
+    return strlen(name) == length && !strncmp(str, name, length);
+}
+
+static bool blk_config_parse_size(const char *str, size_t length,
+                                  size_t *value)
+{
+    // Digits, then an optional k, m or g multiplier.
+    char *end;
+    unsigned long long number = strtoull(str, &end, 10);
+    size_t digits = end - str;
+    if (!digits || str[0] == '-')
+    {
+        return false;
+    }
+
+    unsigned shift = 0;
+    if (digits + 1 == length)
+    {
+        switch (*end)
+        {
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            return false;
+        }
+    }
+    else if (digits != length)
+    {
+        return false;
+    }
+
+    if (number > (SIZE_MAX >> shift))
+    {
+        return false;
+    }
+
+    *value = (size_t)number << shift;
+    return true;
+}
+
+static bool blk_config_parse_pair(const char *pair, size_t length)
+{
+    const char *colon = memchr(pair, ':', length);
+    if (!colon)
+    {
+        return false;
+    }
+
+    size_t key_length = colon - pair;
+    const char *value = colon + 1;
+    size_t value_length = length - key_length - 1;
+
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+    {
+        const struct blk_option *option = &options[i];
+        if (!blk_config_match(pair, key_length, option->name))
+        {
+            continue;
+        }
+
+        void *field = (uint8_t *)&config + option->offset;
+        switch (option->type)
+        {
+        case OPTION_SIZE:
+            return blk_config_parse_size(value, value_length, field);
+        case OPTION_BOOL:
+            if (blk_config_match(value, value_length, "true")
+                || blk_config_match(value, value_length, "1"))
+            {
+                *(bool *)field = true;
+                return true;
+            }
+
+            if (blk_config_match(value, value_length, "false")
+                || blk_config_match(value, value_length, "0"))
+            {
+                *(bool *)field = false;
+                return true;
+            }
+
+            return false;
+        case OPTION_CHOICE:
+            for (int choice = 0; option->choices[choice]; ++choice)
+            {
+                if (blk_config_match(value, value_length,
+                                     option->choices[choice]))
+                {
+                    *(int *)field = choice;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static void blk_config_parse(const char *str)
+{
+    while (*str)
+    {
+        const char *end = strchr(str, ',');
+        size_t length = end ? (size_t)(end - str) : strlen(str);
+
+        // Invalid pairs are reported and skipped, the others still apply.
+        if (length && !blk_config_parse_pair(str, length))
+        {
+            const char *prefix = "blk: invalid " CONFIG_ENV " pair \"";
+            blk_config_write(STDERR_FILENO, prefix, strlen(prefix));
+            blk_config_write(STDERR_FILENO, str, length);
+            blk_config_write(STDERR_FILENO, "\"\n", 2);
+        }
+
+        str += length;
+        if (*str == ',')
+        {
+            ++str;
+        }
+    }
+}
+
+static void blk_config_dump(int fd)
+{
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+    {
+        const struct blk_option *option = &options[i];
+        const void *field = (const uint8_t *)&config + option->offset;
+
+        // Formatted on the stack, nothing is allocated.
+        char line[64];
+        int length = 0;
+        switch (option->type)
+        {
+        case OPTION_SIZE:
+            length = snprintf(line, sizeof(line), "%s:%zu\n", option->name,
+                              *(const size_t *)field);
+            break;
+        case OPTION_BOOL:
+            length = snprintf(line, sizeof(line), "%s:%s\n", option->name,
+                              *(const bool *)field ? "true" : "false");
+            break;
+        case OPTION_CHOICE:
+            length = snprintf(line, sizeof(line), "%s:%s\n", option->name,
+                              option->choices[*(const int *)field]);
+            break;
+        }
+
+        if (length > 0)
+        {
+            blk_config_write(fd, line, (size_t)length);
+        }
+    }
+}
+
+static void blk_config_load(void)
+{
+    // Older variables first, each of them sets a single option.
+    const char *env = getenv(CHECKSUM_ENV);
+    if (env && env[0] == '0')
+    {
+        config.integrity = INTEGRITY_NONE;
+    }
+
+    env = getenv(PERCPU_ENV);
+    if (env && env[0] == '0')
+    {
+        config.percpu_slots = 0;
+    }
+
+    env = getenv(SLAB_ENV);
+    config.slab = env && env[0] == '1';
+
+    env = getenv(TRIM_INTERVAL_ENV);
+    config.trim_interval = env ? strtoul(env, NULL, 10) : 0;
+
+    env = getenv(GUARD_RATE_ENV);
+    config.guard_rate = env ? strtoul(env, NULL, 10) : 0;
+
+    env = getenv(GUARD_SLOTS_ENV);
+    if (env)
+    {
+        config.guard_slots = strtoul(env, NULL, 10);
+    }
+
+    env = getenv(CONFIG_ENV);
+    if (env)
+    {
+        blk_config_parse(env);
+    }
+
+    // The caches cannot hold more blocks than they have slots.
+    if (config.percpu_slots > PERCPU_SLOTS)
+    {
+        config.percpu_slots = PERCPU_SLOTS;
+    }
+
+    if (config.guard_rate > UINT32_MAX)
+    {
+        config.guard_rate = UINT32_MAX;
+    }
+
+    if (config.print)
+    {
+        blk_config_dump(STDERR_FILENO);
+    }
+}
+
+const blk_config *blk_config_get(void)
+{
+    pthread_once(&config_once, blk_config_load);
+    return &config;
+}
+
+__attribute__((visibility("default"))) void blk_config_print(int fd)
+{
+    // Load it first if nothing was allocated yet.
+    blk_config_get();
+    blk_config_dump(fd);
+}
+
+void blk_config_advise(void *addr, size_t size)
+{
+    switch (blk_config_get()->huge_pages)
+    {
+    case HUGE_PAGES_DEFAULT:
+        break;
+    case HUGE_PAGES_ALWAYS:
+        madvise(addr, size, MADV_HUGEPAGE);
+        break;
+    case HUGE_PAGES_NEVER:
+        madvise(addr, size, MADV_NOHUGEPAGE);
+        break;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Environment variable holding the configuration string, a list of
+/// key:value pairs separated by commas (for example "arenas:1,stats:false").
+#define CONFIG_ENV "BLK_MALLOC_CONF"
+
+/// @brief Environment variables read before the configuration string, kept
+/// for compatibility. The string overrides them.
+#define CHECKSUM_ENV "BLK_CHECKSUM"
+#define TRIM_INTERVAL_ENV "BLK_TRIM_INTERVAL"
+#define PERCPU_ENV "BLK_PERCPU_CACHE"
+#define SLAB_ENV "BLK_SLAB"
+#define GUARD_RATE_ENV "BLK_GUARD_RATE"
+#define GUARD_SLOTS_ENV "BLK_GUARD_SLOTS"
+
+/// @brief Macro that define the default number of slots of the guarded pool.
+#define GUARD_DEFAULT_SLOTS 256
+
+enum blk_integrity
+{
+    // Headers are trusted
+    INTEGRITY_NONE,
+    // Headers are checksummed and checked on free
+    INTEGRITY_CHECKSUM,
+};
+
+enum blk_huge_pages
+{
+    // Left to the system settings
+    HUGE_PAGES_DEFAULT,
+    // Asked with MADV_HUGEPAGE
+    HUGE_PAGES_ALWAYS,
+    // Refused with MADV_NOHUGEPAGE
+    HUGE_PAGES_NEVER,
+};
+
+struct blk_config
+{
+    // Arenas, 0 for one per NUMA node
+    size_t arenas;
+
+    // Spans
+    size_t mmap_threshold;
+    size_t retain;
+    enum blk_huge_pages huge_pages;
+    bool async_release;
+
+    // Memory budget, lowered by the cgroup limits, polled every
+    // limit_interval ms
+    size_t memory_limit;
+    size_t limit_interval;
+
+    // Warm-up at load time
+    size_t reserve;
+    bool populate;
+    bool warm_caches;
+
+    // Checks and metrics
+    enum blk_integrity integrity;
+    bool stats;
+    bool latency;
+    size_t latency_signal;
+
+    // Copies and zeroing from this size bypass the cache, 0 to never
+    size_t nt_threshold;
+
+    // Small objects
+    size_t percpu_slots;
+    bool slab;
+
+    // Background trimming, in ms, 0 to disable
+    size_t trim_interval;
+
+    // Sampled guard pages
+    size_t guard_rate;
+    size_t guard_slots;
+
+    // Print the configuration once loaded
+    bool print;
+};
+
+typedef struct blk_config blk_config;
+
+/// @brief Get the configuration, loaded from the environment on the first
+/// call. Nothing is allocated while parsing.
+/// @return The configuration.
+const blk_config *blk_config_get(void);
+
+/// @brief Write the configuration in use, one key:value pair per line, in the
+/// syntax of the configuration string.
+/// @param fd The file descriptor to write to.
+void blk_config_print(int fd);
+
+/// @brief Apply the huge page policy to a new mapping.
+/// @param addr The start of the mapping.
+/// @param size The size of the mapping.
+void blk_config_advise(void *addr, size_t size);
+
+#endif /* ! CONFIG_H */
@@ -1,25 +0,0 @@
-#include "convert.h"
-
-uint8_t *utilities_blka_to_u8(blk_allocator *blka)
-{
-    void *temp = blka;
-    return temp;
-}
-
-uint8_t *utilities_blk_to_u8(blk_meta *blk)
-{
-    void *temp = blk;
-    return temp;
-}
-
-blk_allocator *utilities_u8_to_blka(uint8_t *blka)
-{
-    void *temp = blka;
-    return temp;
-}
-
-blk_meta *utilities_u8_to_blk(uint8_t *blk)
-{
-    void *temp = blk;
-    return temp;
-}
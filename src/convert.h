@@ -15,16 +15,52 @@
 /// @brief Macro to call utilities_u8_to_blk(1).
 #define U8_TO_BLK(blk) utilities_u8_to_blk(blk)
 
+/// @brief Macro to call utilities_span_to_u8(1).
+#define SPAN_TO_U8(span) utilities_span_to_u8(span)
+
+/// @brief Macro to call utilities_u8_to_span(1).
+#define U8_TO_SPAN(span) utilities_u8_to_span(span)
+
 /// @brief Convert a blk_allocator* to a uint8_t* (used for pointer arithmetic).
-uint8_t *utilities_blka_to_u8(blk_allocator *blka);
+static inline uint8_t *utilities_blka_to_u8(blk_allocator *blka)
+{
+    void *temp = blka;
+    return temp;
+}
 
 /// @brief Convert a blk_meta* to a uint8_t* (used for pointer arithmetic).
-uint8_t *utilities_blk_to_u8(blk_meta *blk);
+static inline uint8_t *utilities_blk_to_u8(blk_meta *blk)
+{
+    void *temp = blk;
+    return temp;
+}
 
 /// @brief Convert a uint8_t* to a blk_allocator*.
-blk_allocator *utilities_u8_to_blka(uint8_t *blka);
+static inline blk_allocator *utilities_u8_to_blka(uint8_t *blka)
+{
+    void *temp = blka;
+    return temp;
+}
 
 /// @brief Convert a uint8_t* to a blk_meta*.
-blk_meta *utilities_u8_to_blk(uint8_t *blk);
+static inline blk_meta *utilities_u8_to_blk(uint8_t *blk)
+{
+    void *temp = blk;
+    return temp;
+}
+
+/// @brief Convert a blk_span* to a uint8_t* (used for pointer arithmetic).
+static inline uint8_t *utilities_span_to_u8(blk_span *span)
+{
+    void *temp = span;
+    return temp;
+}
+
+/// @brief Convert a uint8_t* to a blk_span*.
+static inline blk_span *utilities_u8_to_span(uint8_t *span)
+{
+    void *temp = span;
+    return temp;
+}
 
 #endif /* ! CONVERT_H */
@@ -0,0 +1,237 @@
+#include "copy.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#if defined(__x86_64__)
+#    include <immintrin.h>
+#endif
+
+typedef void (*blk_copy_kernel)(void *dst, const void *src, size_t size);
+typedef void (*blk_zero_kernel)(void *dst, size_t size);
+
+// Kernels picked at init, NULL to use memcpy() and memset() at every size.
+static blk_copy_kernel copy_kernel;
+static blk_zero_kernel zero_kernel;
+static size_t threshold = COPY_NT_THRESHOLD;
+
+#if defined(__x86_64__)
+
+/// @brief Macro that define the bytes written per iteration, a cache line.
+#    define COPY_LINE 64
+
+static size_t blk_copy_head(uint8_t *dst)
+{
+    // Streaming stores need aligned addresses, the head is written first.
+    return (COPY_LINE - ((uintptr_t)dst & (COPY_LINE - 1))) & (COPY_LINE - 1);
+}
+
+static void blk_copy_sse2(void *dst, const void *src, size_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t head = blk_copy_head(d);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= COPY_LINE)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)s);
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_stream_si128((__m128i *)d, a);
+        _mm_stream_si128((__m128i *)(d + 16), b);
+        _mm_stream_si128((__m128i *)(d + 32), c);
+        _mm_stream_si128((__m128i *)(d + 48), e);
+
+        d += COPY_LINE;
+        s += COPY_LINE;
+        size -= COPY_LINE;
+    }
+
+    // Order the streaming stores before the block is handed out.
+    _mm_sfence();
+    memcpy(d, s, size);
+}
+
+static void blk_zero_sse2(void *dst, size_t size)
+{
+    uint8_t *d = dst;
+    size_t head = blk_copy_head(d);
+    memset(d, 0, head);
+    d += head;
+    size -= head;
+
+    __m128i zero = _mm_setzero_si128();
+    while (size >= COPY_LINE)
+    {
+        _mm_stream_si128((__m128i *)d, zero);
+        _mm_stream_si128((__m128i *)(d + 16), zero);
+        _mm_stream_si128((__m128i *)(d + 32), zero);
+        _mm_stream_si128((__m128i *)(d + 48), zero);
+
+        d += COPY_LINE;
+        size -= COPY_LINE;
+    }
+
+    _mm_sfence();
+    memset(d, 0, size);
+}
+
+__attribute__((target("avx2"))) static void
+blk_copy_avx2(void *dst, const void *src, size_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t head = blk_copy_head(d);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= COPY_LINE)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        _mm256_stream_si256((__m256i *)d, a);
+        _mm256_stream_si256((__m256i *)(d + 32), b);
+
+        d += COPY_LINE;
+        s += COPY_LINE;
+        size -= COPY_LINE;
+    }
+
+    _mm_sfence();
+    memcpy(d, s, size);
+}
+
+__attribute__((target("avx2"))) static void blk_zero_avx2(void *dst,
+                                                          size_t size)
+{
+    uint8_t *d = dst;
+    size_t head = blk_copy_head(d);
+    memset(d, 0, head);
+    d += head;
+    size -= head;
+
+    __m256i zero = _mm256_setzero_si256();
+    while (size >= COPY_LINE)
+    {
+        _mm256_stream_si256((__m256i *)d, zero);
+        _mm256_stream_si256((__m256i *)(d + 32), zero);
+
+        d += COPY_LINE;
+        size -= COPY_LINE;
+    }
+
+    _mm_sfence();
+    memset(d, 0, size);
+}
+
+__attribute__((target("avx512f"))) static void
+blk_copy_avx512(void *dst, const void *src, size_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t head = blk_copy_head(d);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= COPY_LINE)
+    {
+        _mm512_stream_si512((__m512i *)d, _mm512_loadu_si512(s));
+
+        d += COPY_LINE;
+        s += COPY_LINE;
+        size -= COPY_LINE;
+    }
+
+    _mm_sfence();
+    memcpy(d, s, size);
+}
+
+__attribute__((target("avx512f"))) static void blk_zero_avx512(void *dst,
+                                                              size_t size)
+{
+    uint8_t *d = dst;
+    size_t head = blk_copy_head(d);
+    memset(d, 0, head);
+    d += head;
+    size -= head;
+
+    __m512i zero = _mm512_setzero_si512();
+    while (size >= COPY_LINE)
+    {
+        _mm512_stream_si512((__m512i *)d, zero);
+
+        d += COPY_LINE;
+        size -= COPY_LINE;
+    }
+
+    _mm_sfence();
+    memset(d, 0, size);
+}
+
+#endif /* __x86_64__ */
+
+void blk_copy_init(void)
+{
+    threshold = blk_config_get()->nt_threshold;
+
+#if defined(__x86_64__)
+    // The kernels write an unaligned head of up to a line first, smaller
+    // thresholds would let them run past the end of the block.
+    if (threshold && threshold < 2 * COPY_LINE)
+    {
+        threshold = 2 * COPY_LINE;
+    }
+
+    // SSE2 is part of x86-64, the wider ones are checked at runtime.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        copy_kernel = blk_copy_avx512;
+        zero_kernel = blk_zero_avx512;
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        copy_kernel = blk_copy_avx2;
+        zero_kernel = blk_zero_avx2;
+    }
+    else
+    {
+        copy_kernel = blk_copy_sse2;
+        zero_kernel = blk_zero_sse2;
+    }
+#endif
+}
+
+void blk_copy(void *dst, const void *src, size_t size)
+{
+    // Smaller blocks stay in the cache, where the caller uses them next.
+    if (!copy_kernel || !threshold || size < threshold)
+    {
+        memcpy(dst, src, size);
+        return;
+    }
+
+    copy_kernel(dst, src, size);
+}
+
+void blk_zero(void *dst, size_t size)
+{
+    if (!zero_kernel || !threshold || size < threshold)
+    {
+        memset(dst, 0, size);
+        return;
+    }
+
+    zero_kernel(dst, size);
+}
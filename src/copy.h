@@ -0,0 +1,27 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <stddef.h>
+
+/// @brief Macro that define the size from which blocks are copied and zeroed
+/// with non-temporal stores by default, larger than the usual L2 cache.
+#define COPY_NT_THRESHOLD (1024 * 1024)
+
+/// @brief Pick the widest kernels the CPU supports (AVX-512, AVX2 or SSE2)
+/// and read the nt_threshold option.
+void blk_copy_init(void);
+
+/// @brief Copy a block, bypassing the cache for the destination when it is
+/// at least nt_threshold bytes, so a large realloc() does not evict the
+/// working set of the program.
+/// @param dst The destination.
+/// @param src The source, not overlapping the destination.
+/// @param size The number of bytes.
+void blk_copy(void *dst, const void *src, size_t size);
+
+/// @brief Set a block to 0, bypassing the cache from nt_threshold bytes.
+/// @param dst The destination.
+/// @param size The number of bytes.
+void blk_zero(void *dst, size_t size);
+
+#endif /* ! COPY_H */
@@ -0,0 +1,384 @@
+#include "guard.h"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unwind.h>
+
+#include "allocator.h"
+#include "config.h"
+
+enum blk_guard_state
+{
+    GUARD_EMPTY,
+    GUARD_ALLOCATED,
+    GUARD_FREED,
+};
+
+struct blk_guard_trace
+{
+    long tid;
+    int depth;
+    void *frames[GUARD_STACK_DEPTH];
+};
+
+struct blk_guard_slot
+{
+    // Block info
+    uint8_t *ptr;
+    size_t size;
+    enum blk_guard_state state;
+
+    // Where it was allocated and freed
+    struct blk_guard_trace allocation;
+    struct blk_guard_trace deallocation;
+};
+
+// Pool of 2 * slot_count + 1 pages, every data page between 2 guard pages.
+static uint8_t *pool;
+static size_t pool_size;
+static size_t page_size;
+
+// Slots of the pool, reused in a round robin so a freed block stays
+// protected as long as possible.
+static struct blk_guard_slot *slots;
+static size_t slot_count;
+static size_t next_slot;
+static blk_lock lock;
+
+// Sampling rate, 0 while disabled.
+static uint32_t rate;
+
+// Allocations left before the next sampled one, per thread.
+static __thread uint32_t countdown __attribute__((tls_model("initial-exec")));
+static __thread uint32_t seed __attribute__((tls_model("initial-exec")));
+
+static struct sigaction previous_action;
+
+static void blk_guard_print(const char *format, ...)
+{
+    // Formatted on the stack, the heap may be corrupted.
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length > 0)
+    {
+        size_t size = (size_t)length < sizeof(buffer) ? (size_t)length
+                                                      : sizeof(buffer) - 1;
+        ssize_t ret = write(STDERR_FILENO, buffer, size);
+        (void)ret;
+    }
+}
+
+struct blk_guard_unwind
+{
+    struct blk_guard_trace *trace;
+    int skip;
+};
+
+static _Unwind_Reason_Code blk_guard_unwind_frame(struct _Unwind_Context *ctx,
+                                                  void *arg)
+{
+    struct blk_guard_unwind *unwind = arg;
+    uintptr_t ip = _Unwind_GetIP(ctx);
+    if (!ip || unwind->trace->depth == GUARD_STACK_DEPTH)
+    {
+        return _URC_END_OF_STACK;
+    }
+
+    // Skip the frames of the allocator.
+    if (unwind->skip > 0)
+    {
+        --unwind->skip;
+        return _URC_NO_REASON;
+    }
+
+    unwind->trace->frames[unwind->trace->depth++] = (void *)ip;
+    return _URC_NO_REASON;
+}
+
+static void blk_guard_record(struct blk_guard_trace *trace)
+{
+    struct blk_guard_unwind unwind = { trace, 2 };
+    trace->tid = syscall(SYS_gettid);
+    trace->depth = 0;
+    _Unwind_Backtrace(blk_guard_unwind_frame, &unwind);
+}
+
+static void blk_guard_print_trace(const char *what,
+                                  const struct blk_guard_trace *trace)
+{
+    blk_guard_print("%s by thread %ld:\n", what, trace->tid);
+    backtrace_symbols_fd(trace->frames, trace->depth, STDERR_FILENO);
+}
+
+static void blk_guard_print_slot(const struct blk_guard_slot *slot)
+{
+    blk_guard_print("block of %zu bytes at %p\n", slot->size,
+                    (void *)slot->ptr);
+    blk_guard_print_trace("allocated", &slot->allocation);
+    if (slot->state == GUARD_FREED)
+    {
+        blk_guard_print_trace("freed", &slot->deallocation);
+    }
+}
+
+static uint32_t blk_guard_next_countdown(void)
+{
+    // Xorshift, seeded per thread from its TLS address and the clock.
+    if (!seed)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        seed = (uint32_t)(uintptr_t)&seed ^ (uint32_t)now.tv_nsec;
+        seed = seed ? seed : 1;
+    }
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    // Uniform in [1, 2 * rate], rate on average.
+    return 1 + seed % (2 * rate);
+}
+
+static uint8_t *blk_guard_page_of(const struct blk_guard_slot *slot)
+{
+    return pool + (2 * (slot - slots) + 1) * page_size;
+}
+
+static struct blk_guard_slot *blk_guard_slot_of(const void *ptr)
+{
+    size_t page = ((const uint8_t *)ptr - pool) / page_size;
+    if (page % 2 == 0)
+    {
+        return NULL;
+    }
+
+    return &slots[page / 2];
+}
+
+static void blk_guard_report(uint8_t *addr)
+{
+    size_t page = (addr - pool) / page_size;
+    size_t offset = (addr - pool) % page_size;
+
+    blk_guard_print("==%ld== blk guard: ", (long)getpid());
+    if (page % 2)
+    {
+        struct blk_guard_slot *slot = &slots[page / 2];
+        if (slot->state == GUARD_FREED)
+        {
+            blk_guard_print("use-after-free on %p\n", (void *)addr);
+            blk_guard_print_slot(slot);
+            return;
+        }
+
+        blk_guard_print("invalid access on %p\n", (void *)addr);
+        return;
+    }
+
+    // A guard page belongs to the closest of its two data pages.
+    size_t index = page / 2;
+    if ((offset < page_size / 2 && page > 0) || index == slot_count)
+    {
+        index -= 1;
+    }
+
+    struct blk_guard_slot *slot = &slots[index];
+    if (slot->state == GUARD_EMPTY)
+    {
+        blk_guard_print("invalid access on %p\n", (void *)addr);
+        return;
+    }
+
+    if (addr >= slot->ptr)
+    {
+        blk_guard_print("buffer overflow on %p, %zu bytes after the block\n",
+                        (void *)addr, (size_t)(addr - slot->ptr) - slot->size);
+    }
+    else
+    {
+        blk_guard_print("buffer underflow on %p, %zu bytes before the block\n",
+                        (void *)addr, (size_t)(slot->ptr - addr));
+    }
+
+    blk_guard_print_slot(slot);
+}
+
+static void blk_guard_handler(int sig, siginfo_t *info, void *context)
+{
+    (void)context;
+
+    // Faults elsewhere go to the previous handler when retried.
+    if (!blk_guard_owns(info->si_addr))
+    {
+        sigaction(sig, &previous_action, NULL);
+        return;
+    }
+
+    blk_guard_report(info->si_addr);
+
+    // Crash on the faulting access.
+    signal(sig, SIG_DFL);
+}
+
+void blk_guard_init(void)
+{
+    const blk_config *config = blk_config_get();
+    uint32_t sample_rate = config->guard_rate;
+    if (!sample_rate)
+    {
+        return;
+    }
+
+    slot_count = config->guard_slots;
+    if (!slot_count)
+    {
+        return;
+    }
+
+    // Only the data pages are made accessible, while they are in use.
+    page_size = PAGE_SIZE;
+    pool_size = (2 * slot_count + 1) * page_size;
+    void *addr = mmap(NULL, pool_size, PROT_NONE, MAP_FLAGS | MAP_NORESERVE,
+                      -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        return;
+    }
+
+    void *slots_addr = mmap(NULL, slot_count * sizeof(struct blk_guard_slot),
+                            PROT_FLAGS, MAP_FLAGS, -1, 0);
+    if (slots_addr == MAP_FAILED)
+    {
+        munmap(addr, pool_size);
+        return;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = blk_guard_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_action);
+
+    pool = addr;
+    slots = slots_addr;
+    blk_lock_init(&lock);
+    rate = sample_rate;
+}
+
+// Kept out of the callers, only one allocation out of rate gets here.
+__attribute__((noinline, cold)) static void *blk_guard_sample(size_t size)
+{
+    // The first allocation of a thread only starts its countdown.
+    bool sampled = countdown == 1;
+    countdown = blk_guard_next_countdown();
+    if (!sampled || size > page_size - MIN_DATA_SIZE)
+    {
+        return NULL;
+    }
+
+    struct blk_guard_trace trace;
+    blk_guard_record(&trace);
+
+    blk_lock_acquire(&lock);
+
+    // Take the next slot that is not in use.
+    struct blk_guard_slot *slot = NULL;
+    for (size_t i = 0; i < slot_count && !slot; ++i)
+    {
+        struct blk_guard_slot *candidate = &slots[next_slot];
+        next_slot = (next_slot + 1) % slot_count;
+        if (candidate->state != GUARD_ALLOCATED)
+        {
+            slot = candidate;
+        }
+    }
+
+    if (!slot)
+    {
+        blk_lock_release(&lock);
+        return NULL;
+    }
+
+    // Place the block against the next guard page.
+    uint8_t *page = blk_guard_page_of(slot);
+    mprotect(page, page_size, PROT_FLAGS);
+    slot->size = size;
+    slot->ptr = page + page_size - blk_align_size(size ? size : 1);
+    slot->state = GUARD_ALLOCATED;
+    slot->allocation = trace;
+
+    blk_lock_release(&lock);
+
+    return slot->ptr;
+}
+
+void *blk_guard_malloc(size_t size)
+{
+    if (!rate)
+    {
+        return NULL;
+    }
+
+    if (countdown > 1)
+    {
+        --countdown;
+        return NULL;
+    }
+
+    return blk_guard_sample(size);
+}
+
+bool blk_guard_owns(const void *ptr)
+{
+    const uint8_t *ptr_p = ptr;
+    return pool && ptr_p >= pool && ptr_p < pool + pool_size;
+}
+
+void blk_guard_free(void *ptr)
+{
+    struct blk_guard_trace trace;
+    blk_guard_record(&trace);
+
+    blk_lock_acquire(&lock);
+
+    struct blk_guard_slot *slot = blk_guard_slot_of(ptr);
+    if (!slot || slot->state != GUARD_ALLOCATED || slot->ptr != ptr)
+    {
+        blk_guard_print("==%ld== blk guard: %s of %p\n", (long)getpid(),
+                        slot && slot->ptr == ptr ? "double free"
+                                                 : "invalid free",
+                        ptr);
+        if (slot && slot->state != GUARD_EMPTY)
+        {
+            blk_guard_print_slot(slot);
+        }
+
+        blk_guard_print_trace("freed again", &trace);
+        abort();
+    }
+
+    // Any later access to the block faults.
+    slot->state = GUARD_FREED;
+    slot->deallocation = trace;
+    mprotect(blk_guard_page_of(slot), page_size, PROT_NONE);
+
+    blk_lock_release(&lock);
+}
+
+size_t blk_guard_size(const void *ptr)
+{
+    struct blk_guard_slot *slot = blk_guard_slot_of(ptr);
+    return slot ? slot->size : 0;
+}
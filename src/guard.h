@@ -0,0 +1,35 @@
+#ifndef GUARD_H
+#define GUARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// @brief Macro that define the number of frames kept per stack trace.
+#define GUARD_STACK_DEPTH 16
+
+/// @brief Map the guarded pool and install the fault handler when sampling is
+/// requested by the configuration (guard_rate, 1 allocation out of this many
+/// on average is sampled, and guard_slots).
+void blk_guard_init(void);
+
+/// @brief Allocate a sampled block, placed right before a PROT_NONE page.
+/// @param size The size of the block.
+/// @return A data pointer, NULL if this allocation is not sampled.
+void *blk_guard_malloc(size_t size);
+
+/// @brief Tell if a pointer lives in the guarded pool.
+/// @param ptr The pointer.
+/// @return true if it does, false otherwise.
+bool blk_guard_owns(const void *ptr);
+
+/// @brief Free a sampled block, its page is protected until the slot is
+/// reused. A double free is reported and aborts.
+/// @param ptr The data pointer.
+void blk_guard_free(void *ptr);
+
+/// @brief Get the size requested for a sampled block.
+/// @param ptr The data pointer.
+/// @return The size of the block.
+size_t blk_guard_size(const void *ptr);
+
+#endif /* ! GUARD_H */
@@ -0,0 +1,90 @@
+#include "allocator.h"
+#include "libmalloc.h"
+#include "snapshot.h"
+
+__attribute__((visibility("default"))) blk_heap *blk_heap_create(size_t size)
+{
+    // The handle has its own page so a reset never touches it.
+    void *addr =
+        mmap(NULL, sizeof(blk_allocator), PROT_FLAGS, MAP_FLAGS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    blk_allocator *heap = addr;
+    blk_init_arena(heap, size, HEAP_ARENA, -1);
+    if (!heap->meta)
+    {
+        munmap(addr, sizeof(blk_allocator));
+        return NULL;
+    }
+
+    return heap;
+}
+
+__attribute__((visibility("default"))) void *blk_heap_malloc(blk_heap *heap,
+                                                             size_t size)
+{
+    // Lock the heap.
+    blk_lock_acquire(&heap->lock);
+
+    // Call blk_malloc.
+    void *ptr = blk_malloc(heap, size);
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+
+    return ptr;
+}
+
+__attribute__((visibility("default"))) void blk_heap_free(blk_heap *heap,
+                                                          void *ptr)
+{
+    // Lock the heap.
+    blk_lock_acquire(&heap->lock);
+
+    // Call blk_free.
+    blk_free(heap, ptr);
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+}
+
+__attribute__((visibility("default"))) void blk_heap_reset(blk_heap *heap)
+{
+    // Lock the heap.
+    blk_lock_acquire(&heap->lock);
+
+    // Call blk_reset_allocator.
+    blk_reset_allocator(heap);
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+}
+
+__attribute__((visibility("default"))) int blk_heap_snapshot(blk_heap *heap,
+                                                             int fd)
+{
+    // Lock the heap.
+    blk_lock_acquire(&heap->lock);
+
+    // Call blk_snapshot_write.
+    bool written = blk_snapshot_write(heap, fd);
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+
+    return written ? 0 : -1;
+}
+
+__attribute__((visibility("default"))) void blk_heap_destroy(blk_heap *heap)
+{
+    if (!heap)
+    {
+        return;
+    }
+
+    blk_cleanup_allocator(heap);
+    munmap(heap, sizeof(blk_allocator));
+}
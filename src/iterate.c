@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+
+#include "iterate.h"
+
+#include <stdlib.h>
+
+#include "convert.h"
+#include "pagemap.h"
+
+bool blk_iterate_add(struct blk_iterate_buffer *buffer, void *ptr,
+                     size_t size, bool used)
+{
+    if (buffer->count == buffer->capacity)
+    {
+        size_t record_size = sizeof(struct blk_iterate_record);
+        size_t old_size = buffer->capacity * record_size;
+        void *addr = buffer->records
+            ? mremap(buffer->records, old_size, 2 * old_size, MREMAP_MAYMOVE)
+            : mmap(NULL, ITERATE_RECORDS * record_size, PROT_FLAGS, MAP_FLAGS,
+                   -1, 0);
+        if (addr == MAP_FAILED)
+        {
+            return false;
+        }
+
+        buffer->records = addr;
+        buffer->capacity =
+            buffer->capacity ? 2 * buffer->capacity : ITERATE_RECORDS;
+    }
+
+    struct blk_iterate_record *record = &buffer->records[buffer->count++];
+    record->ptr = ptr;
+    record->size = size;
+    record->used = used;
+    return true;
+}
+
+static int blk_iterate_compare(const void *a, const void *b)
+{
+    const struct blk_iterate_record *ra = a;
+    const struct blk_iterate_record *rb = b;
+    uintptr_t pa = (uintptr_t)ra->ptr;
+    uintptr_t pb = (uintptr_t)rb->ptr;
+    return (pa > pb) - (pa < pb);
+}
+
+void blk_iterate_sort(struct blk_iterate_buffer *buffer)
+{
+    qsort(buffer->records, buffer->count, sizeof(struct blk_iterate_record),
+          blk_iterate_compare);
+}
+
+void blk_iterate_set_free(struct blk_iterate_buffer *buffer, const void *ptr)
+{
+    struct blk_iterate_record key = { (void *)ptr, 0, false };
+    struct blk_iterate_record *record =
+        bsearch(&key, buffer->records, buffer->count,
+                sizeof(struct blk_iterate_record), blk_iterate_compare);
+    if (record)
+    {
+        record->used = false;
+    }
+}
+
+void blk_iterate_flush(struct blk_iterate_buffer *buffer,
+                       blk_iterate_callback callback, void *arg)
+{
+    // The blocks may have changed since, the records stay readable.
+    for (size_t i = 0; i < buffer->count; ++i)
+    {
+        struct blk_iterate_record *record = &buffer->records[i];
+        callback(record->ptr, record->size, record->used, arg);
+    }
+
+    buffer->count = 0;
+}
+
+void blk_iterate_unmap(struct blk_iterate_buffer *buffer)
+{
+    if (buffer->records)
+    {
+        munmap(buffer->records,
+               buffer->capacity * sizeof(struct blk_iterate_record));
+    }
+
+    buffer->records = NULL;
+    buffer->capacity = 0;
+    buffer->count = 0;
+}
+
+static void blk_iterate_attach(blk_allocator *blka,
+                               struct blk_span_cursor *cursor)
+{
+    cursor->span = blka->spans;
+    cursor->next = blka->cursors;
+    blka->cursors = cursor;
+}
+
+static void blk_iterate_detach(blk_allocator *blka,
+                               struct blk_span_cursor *cursor)
+{
+    struct blk_span_cursor **link = &blka->cursors;
+    while (*link != cursor)
+    {
+        link = &(*link)->next;
+    }
+
+    *link = cursor->next;
+}
+
+static bool blk_iterate_span(blk_span *span, struct blk_iterate_buffer *buffer)
+{
+    uint8_t *addr_p = SPAN_TO_U8(span) + sizeof(blk_span);
+    for (blk_meta *blk = U8_TO_BLK(addr_p); !blk->garbage; blk = blk->next)
+    {
+        // Blocks in a per-CPU cache are allocated for the arena only.
+        void *ptr = BLK_TO_U8(blk) + sizeof(blk_meta);
+        bool used = !blk->is_free && !blk_percpu_has_key(ptr);
+        if (!blk_iterate_add(buffer, ptr, blk->size, used))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool blk_iterate_slab(blk_slab *slab, struct blk_iterate_buffer *buffer)
+{
+    for (size_t i = 0; i < slab->capacity; ++i)
+    {
+        // Free objects have their bit set, the cached ones hold the key.
+        uint8_t *ptr = slab->base + i * slab->size;
+        bool is_free = slab->bitmap[i / 64] & ((uint64_t)1 << (i % 64));
+        bool used = !is_free && !blk_percpu_has_key(ptr);
+        if (!blk_iterate_add(buffer, ptr, slab->size, used))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool blk_iterate_slabs(blk_allocator *blka,
+                              blk_iterate_callback callback, void *arg)
+{
+    if (!blk_slab_enabled())
+    {
+        return true;
+    }
+
+    struct blk_iterate_buffer buffer = { NULL, 0, 0 };
+    uintptr_t addr = 0;
+    bool walked = true;
+
+    blk_slab *slab;
+    while (walked && (slab = blk_pagemap_next_slab(&addr)))
+    {
+        // Descriptors are never unmapped, the owner is read again under the
+        // lock once the page is known to still be in the slab.
+        uintptr_t next = addr + ((uintptr_t)1 << PAGEMAP_PAGE_SHIFT);
+        if (__atomic_load_n(&slab->owner, __ATOMIC_RELAXED) != blka)
+        {
+            addr = next;
+            continue;
+        }
+
+        // Lock the arena.
+        blk_lock_acquire(&blka->lock);
+
+        // Call blk_iterate_slab, unless it was destroyed meanwhile.
+        bool recorded = blk_pagemap_get_slab((void *)addr) == slab
+            && slab->owner == blka;
+        if (recorded)
+        {
+            next = (uintptr_t)slab->base + SLAB_SIZE;
+            walked = blk_iterate_slab(slab, &buffer);
+        }
+
+        // Unlock the arena.
+        blk_lock_release(&blka->lock);
+
+        addr = next;
+        if (recorded && walked)
+        {
+            blk_iterate_flush(&buffer, callback, arg);
+        }
+    }
+
+    blk_iterate_unmap(&buffer);
+    return walked;
+}
+
+bool blk_iterate(blk_allocator *blka, blk_iterate_callback callback,
+                 void *arg)
+{
+    struct blk_iterate_buffer buffer = { NULL, 0, 0 };
+    struct blk_span_cursor cursor;
+    bool walked = true;
+
+    // Lock the allocator.
+    blk_lock_acquire(&blka->lock);
+
+    // Call blk_iterate_attach.
+    blk_iterate_attach(blka, &cursor);
+
+    // Unlock the allocator.
+    blk_lock_release(&blka->lock);
+
+    while (walked)
+    {
+        // Lock the allocator.
+        blk_lock_acquire(&blka->lock);
+
+        // Call blk_iterate_span, on the span under the cursor.
+        blk_span *span = cursor.span;
+        if (span)
+        {
+            cursor.span = span->next;
+            walked = blk_iterate_span(span, &buffer);
+        }
+
+        // Call blk_iterate_detach, once the walk is over.
+        if (!span || !walked)
+        {
+            blk_iterate_detach(blka, &cursor);
+        }
+
+        // Unlock the allocator.
+        blk_lock_release(&blka->lock);
+
+        if (!span || !walked)
+        {
+            break;
+        }
+
+        blk_iterate_flush(&buffer, callback, arg);
+    }
+
+    blk_iterate_unmap(&buffer);
+    return walked && blk_iterate_slabs(blka, callback, arg);
+}
+
+void blk_iterate_count(void *ptr, size_t size, int used, void *arg)
+{
+    struct blk_iterate_info *info = arg;
+    (void)ptr;
+
+    if (used)
+    {
+        ++info->used_count;
+        info->used_size += size;
+        return;
+    }
+
+    // Class of the highest bit, from 16 bytes on.
+    int cls = 0;
+    while (cls + 1 < ITERATE_INFO_CLASSES && size >> (cls + 5))
+    {
+        ++cls;
+    }
+
+    ++info->class_count[cls];
+    info->class_size[cls] += size;
+    ++info->free_count;
+    info->free_size += size;
+}
+
+static void blk_iterate_print_sizes(FILE *stream,
+                                    const struct blk_iterate_info *info)
+{
+    // Only the classes holding free blocks are listed.
+    fprintf(stream, "<sizes>\n");
+    for (int cls = 0; cls < ITERATE_INFO_CLASSES; ++cls)
+    {
+        if (!info->class_count[cls])
+        {
+            continue;
+        }
+
+        size_t from = cls ? (size_t)16 << cls : 0;
+        size_t to = cls + 1 < ITERATE_INFO_CLASSES
+            ? ((size_t)32 << cls) - 1
+            : SIZE_MAX;
+        fprintf(stream,
+                "  <size from=\"%zu\" to=\"%zu\" total=\"%zu\" "
+                "count=\"%zu\"/>\n",
+                from, to, info->class_size[cls], info->class_count[cls]);
+    }
+
+    fprintf(stream, "</sizes>\n");
+}
+
+void blk_iterate_print(FILE *stream, const struct blk_iterate_info *info,
+                       size_t mapped, bool sizes)
+{
+    if (sizes)
+    {
+        blk_iterate_print_sizes(stream, info);
+    }
+
+    // There are no fast bins, every free block counts as rest.
+    fprintf(stream, "<total type=\"fast\" count=\"0\" size=\"0\"/>\n");
+    fprintf(stream, "<total type=\"rest\" count=\"%zu\" size=\"%zu\"/>\n",
+            info->free_count, info->free_size);
+    fprintf(stream, "<total type=\"used\" count=\"%zu\" size=\"%zu\"/>\n",
+            info->used_count, info->used_size);
+    fprintf(stream, "<system type=\"current\" size=\"%zu\"/>\n", mapped);
+    fprintf(stream, "<aspace type=\"total\" size=\"%zu\"/>\n", mapped);
+}
@@ -0,0 +1,155 @@
+#ifndef ITERATE_H
+#define ITERATE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "allocator.h"
+#include "libmalloc.h"
+#include "slab.h"
+
+/// @brief Macro that define the number of block records mapped at first,
+/// the buffer doubles when a span or a cache holds more blocks.
+#define ITERATE_RECORDS 4096
+
+/// @brief Macro that define the size classes of the free blocks reported by
+/// malloc_info(), powers of two from 16 bytes, the last one holding the
+/// larger blocks too.
+#define ITERATE_INFO_CLASSES 24
+
+struct blk_iterate_record
+{
+    // Data of the block, as returned by malloc()
+    void *ptr;
+    size_t size;
+    bool used;
+};
+
+struct blk_iterate_buffer
+{
+    // Records of the blocks of the span, slab or cache being walked, mapped
+    // outside of the arenas
+    struct blk_iterate_record *records;
+    size_t capacity;
+    size_t count;
+};
+
+struct blk_iterate_info
+{
+    // Free blocks per power of two
+    size_t class_count[ITERATE_INFO_CLASSES];
+    size_t class_size[ITERATE_INFO_CLASSES];
+
+    // Totals
+    size_t free_count;
+    size_t free_size;
+    size_t used_count;
+    size_t used_size;
+};
+
+/// @brief Append a record to a buffer, doubling it when full. The buffer is
+/// mapped apart so the arenas are not touched.
+/// @param buffer The buffer.
+/// @param ptr The block.
+/// @param size Its size.
+/// @param used true if it is allocated, false if it is free.
+/// @return true if it succeeded, false if the buffer could not grow.
+bool blk_iterate_add(struct blk_iterate_buffer *buffer, void *ptr,
+                     size_t size, bool used);
+
+/// @brief Sort the records of a buffer in address order, for
+/// blk_iterate_set_free().
+/// @param buffer The buffer.
+void blk_iterate_sort(struct blk_iterate_buffer *buffer);
+
+/// @brief Mark the record of a block as free, in a sorted buffer.
+/// @param buffer The buffer.
+/// @param ptr The block, ignored if it has no record.
+void blk_iterate_set_free(struct blk_iterate_buffer *buffer, const void *ptr);
+
+/// @brief Call a callback on the records of a buffer and empty it.
+/// @param buffer The buffer.
+/// @param callback The callback.
+/// @param arg Passed to the callback.
+void blk_iterate_flush(struct blk_iterate_buffer *buffer,
+                       blk_iterate_callback callback, void *arg);
+
+/// @brief Unmap the records of a buffer.
+/// @param buffer The buffer.
+void blk_iterate_unmap(struct blk_iterate_buffer *buffer);
+
+/// @brief Register a cursor on the first span of an allocator, then moved on
+/// by blk_new_page() and blk_unmap_span() so it always names a mapped span.
+/// @param blka The block allocator, its lock held by the caller.
+/// @param cursor The cursor.
+/// static void blk_iterate_attach(blk_allocator *blka,
+///                                struct blk_span_cursor *cursor);
+
+/// @brief Unregister a cursor.
+/// @param blka The block allocator, its lock held by the caller.
+/// @param cursor The cursor.
+/// static void blk_iterate_detach(blk_allocator *blka,
+///                                struct blk_span_cursor *cursor);
+
+/// @brief Record the blocks of a span, up to its end block. The blocks held
+/// by the per-CPU caches are recorded as free.
+/// @param span The span, the lock of its allocator held by the caller.
+/// @param buffer The buffer receiving the records, grown when needed.
+/// @return true if it succeeded, false if the buffer could not grow.
+/// static bool blk_iterate_span(blk_span *span,
+///                              struct blk_iterate_buffer *buffer);
+
+/// @brief Record the objects of a slab. The objects held by the per-CPU
+/// caches are recorded as free.
+/// @param slab The slab, the lock of its owner held by the caller.
+/// @param buffer The buffer receiving the records, grown when needed.
+/// @return true if it succeeded, false if the buffer could not grow.
+/// static bool blk_iterate_slab(blk_slab *slab,
+///                              struct blk_iterate_buffer *buffer);
+
+/// @brief Call a callback on every object of the slabs of an arena, found
+/// through the page map. The arena is only locked while a slab is recorded.
+/// @param blka The arena.
+/// @param callback The callback.
+/// @param arg Passed to the callback.
+/// @return true if every slab was walked, false if out of memory.
+/// static bool blk_iterate_slabs(blk_allocator *blka,
+///                               blk_iterate_callback callback, void *arg);
+
+/// @brief Write the free blocks per size class, as the <sizes> element of
+/// malloc_info().
+/// @param stream The stream to write to.
+/// @param info The counters.
+/// static void blk_iterate_print_sizes(FILE *stream,
+///                                     const struct blk_iterate_info *info);
+
+/// @brief Call a callback on every block of an allocator, span by span in
+/// the order they were mapped, then on the objects of its slabs. The lock is
+/// only held while a span or a slab is recorded, the callbacks run without it
+/// and may allocate and free. Each step costs O(1) in the number of spans.
+/// @param blka The block allocator.
+/// @param callback The callback.
+/// @param arg Passed to the callback.
+/// @return true if every span was walked, false if out of memory.
+bool blk_iterate(blk_allocator *blka, blk_iterate_callback callback,
+                 void *arg);
+
+/// @brief Callback of blk_iterate() adding a block to the counters of a
+/// struct blk_iterate_info.
+/// @param ptr The block.
+/// @param size Its size.
+/// @param used 1 if it is allocated, 0 if it is free.
+/// @param arg The struct blk_iterate_info.
+void blk_iterate_count(void *ptr, size_t size, int used, void *arg);
+
+/// @brief Write the counters of an arena, or of all of them, as the XML
+/// elements of malloc_info(), in the format of glibc.
+/// @param stream The stream to write to.
+/// @param info The counters.
+/// @param mapped The bytes mapped.
+/// @param sizes true to list the free blocks per size class, as done for
+/// each arena.
+void blk_iterate_print(FILE *stream, const struct blk_iterate_info *info,
+                       size_t mapped, bool sizes);
+
+#endif /* ! ITERATE_H */
@@ -0,0 +1,341 @@
+#include "latency.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "config.h"
+#include "lock.h"
+
+bool blk_latency_enabled;
+__thread int blk_latency_path;
+
+// Histograms of the current thread, taken on its first timed call. Its counts
+// move to the retired ones when it exits, and the histograms go to the next
+// thread.
+static __thread struct blk_latency_histograms *histograms
+    __attribute__((tls_model("initial-exec")));
+
+// Set once the histograms of the thread are given back, the calls made while
+// it exits go straight to the retired counts.
+static __thread bool exited __attribute__((tls_model("initial-exec")));
+
+// Every histograms ever mapped, never unmapped so readers need no lock.
+static struct blk_latency_histograms *all_histograms;
+
+// Counts of the exited threads, and their histograms to reuse.
+static struct blk_latency_histograms retired;
+static struct blk_latency_histograms *free_histograms;
+static blk_lock free_lock;
+
+static pthread_key_t thread_key;
+
+// Clock and ticks at startup, compared to the current ones to convert ticks
+// to nanoseconds.
+static struct timespec start_time;
+static uint64_t start_ticks;
+
+static const char *const op_names[LATENCY_OPS] = { "malloc", "free",
+                                                   "realloc", "calloc" };
+static const char *const path_names[LATENCY_PATHS] = { "cache", "list",
+                                                       "extend", "mmap" };
+static const char *const class_names[LATENCY_CLASSES] = {
+    "<=64", "<=256", "<=1K", "<=4K", "<=16K", "<=64K", "<=256K", ">256K",
+};
+
+static int blk_latency_class_of(size_t size)
+{
+    if (size <= 64)
+    {
+        return 0;
+    }
+
+    // Each class is 4 times larger than the previous one.
+    int bits = 64 - __builtin_clzll(size - 1);
+    int cls = (bits - 5) / 2;
+    return cls < LATENCY_CLASSES ? cls : LATENCY_CLASSES - 1;
+}
+
+static int blk_latency_bucket_of(uint64_t ticks)
+{
+    // Small values have a bucket each, larger ones share one per quarter of
+    // a power of two.
+    uint64_t max = (1ULL << 40) - 1;
+    ticks = ticks < max ? ticks : max;
+    if (ticks < (1U << (LATENCY_SUB_BITS + 1)))
+    {
+        return ticks;
+    }
+
+    int shift = 64 - __builtin_clzll(ticks) - (LATENCY_SUB_BITS + 1);
+    return (shift << LATENCY_SUB_BITS) + (ticks >> shift);
+}
+
+static uint64_t blk_latency_bucket_max(int bucket)
+{
+    if (bucket < (1 << (LATENCY_SUB_BITS + 1)))
+    {
+        return bucket;
+    }
+
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t mantissa = (bucket & ((1 << LATENCY_SUB_BITS) - 1))
+        + (1 << LATENCY_SUB_BITS);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static void blk_latency_thread_exit(void *arg)
+{
+    struct blk_latency_histograms *current = arg;
+    uint32_t *counts = &current->counts[0][0][0][0];
+    uint32_t *totals = &retired.counts[0][0][0][0];
+    size_t n = sizeof(current->counts) / sizeof(uint32_t);
+
+    // Move the counts, a reader may miss them for a moment but never sees
+    // them twice.
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint32_t count = __atomic_exchange_n(&counts[i], 0, __ATOMIC_RELAXED);
+        if (count)
+        {
+            __atomic_fetch_add(&totals[i], count, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Lock the free histograms.
+    blk_lock_acquire(&free_lock);
+
+    current->next_free = free_histograms;
+    free_histograms = current;
+
+    // Unlock the free histograms.
+    blk_lock_release(&free_lock);
+
+    histograms = NULL;
+    exited = true;
+}
+
+static struct blk_latency_histograms *blk_latency_histograms(void)
+{
+    if (histograms)
+    {
+        return histograms;
+    }
+
+    if (exited)
+    {
+        return &retired;
+    }
+
+    // Lock the free histograms.
+    blk_lock_acquire(&free_lock);
+
+    struct blk_latency_histograms *current = free_histograms;
+    if (current)
+    {
+        free_histograms = current->next_free;
+    }
+
+    // Unlock the free histograms.
+    blk_lock_release(&free_lock);
+
+    if (!current)
+    {
+        void *addr = mmap(NULL, sizeof(struct blk_latency_histograms),
+                          PROT_FLAGS, MAP_FLAGS, -1, 0);
+        if (addr == MAP_FAILED)
+        {
+            return NULL;
+        }
+
+        // Publish them so blk_latency_print() merges them.
+        current = addr;
+        current->next = __atomic_load_n(&all_histograms, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&all_histograms, &current->next,
+                                            current, true, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+        {
+            continue;
+        }
+    }
+
+    // Give them back when the thread exits.
+    histograms = current;
+    pthread_setspecific(thread_key, current);
+    return current;
+}
+
+static uint64_t blk_latency_merge(uint64_t *merged,
+                                  struct blk_latency_histograms *current,
+                                  int op, int path, int cls)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        uint32_t count = __atomic_load_n(&current->counts[op][path][cls][i],
+                                         __ATOMIC_RELAXED);
+        merged[i] += count;
+        total += count;
+    }
+
+    return total;
+}
+
+void blk_latency_record(int op, size_t size, uint64_t start)
+{
+    uint64_t ticks = blk_latency_now() - start;
+    struct blk_latency_histograms *current = blk_latency_histograms();
+    if (!current)
+    {
+        return;
+    }
+
+    // Only this thread writes its counters, readers may see them late. The
+    // retired ones are shared by the exiting threads.
+    uint32_t *count = &current->counts[op][blk_latency_path]
+                                      [blk_latency_class_of(size)]
+                                      [blk_latency_bucket_of(ticks)];
+    if (current == &retired)
+    {
+        __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+}
+
+static double blk_latency_ns_per_tick(void)
+{
+#if defined(__x86_64__)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ticks = blk_latency_now() - start_ticks;
+    double ns = (now.tv_sec - start_time.tv_sec) * 1e9
+        + (now.tv_nsec - start_time.tv_nsec);
+    return ticks ? ns / ticks : 1;
+#else
+    return 1;
+#endif
+}
+
+static void blk_latency_write(int fd, const char *line, int length)
+{
+    if (length > 0)
+    {
+        ssize_t ret = write(fd, line, length);
+        (void)ret;
+    }
+}
+
+__attribute__((visibility("default"))) void blk_latency_print(int fd)
+{
+    if (!blk_latency_enabled)
+    {
+        return;
+    }
+
+    // Percentiles are printed as the upper bound of their bucket.
+    static const int quantiles[] = { 500, 900, 990, 999 };
+    double ns_per_tick = blk_latency_ns_per_tick();
+    char line[192];
+    int length = snprintf(line, sizeof(line),
+                          "%-8s %-7s %-6s %12s %10s %10s %10s %10s %10s\n",
+                          "op", "path", "size", "count", "p50 ns", "p90 ns",
+                          "p99 ns", "p99.9 ns", "max ns");
+    blk_latency_write(fd, line, length);
+
+    for (int op = 0; op < LATENCY_OPS; ++op)
+    {
+        for (int path = 0; path < LATENCY_PATHS; ++path)
+        {
+            for (int cls = 0; cls < LATENCY_CLASSES; ++cls)
+            {
+                // Merge the histograms of every thread, alive or not.
+                uint64_t merged[LATENCY_BUCKETS] = { 0 };
+                uint64_t total =
+                    blk_latency_merge(merged, &retired, op, path, cls);
+                struct blk_latency_histograms *current =
+                    __atomic_load_n(&all_histograms, __ATOMIC_ACQUIRE);
+                for (; current; current = current->next)
+                {
+                    total += blk_latency_merge(merged, current, op, path, cls);
+                }
+
+                if (!total)
+                {
+                    continue;
+                }
+
+                uint64_t values[5];
+                int bucket = 0;
+                uint64_t seen = 0;
+                for (int q = 0; q < 4; ++q)
+                {
+                    uint64_t rank = (total * quantiles[q] + 999) / 1000;
+                    while (seen + merged[bucket] < rank)
+                    {
+                        seen += merged[bucket++];
+                    }
+
+                    values[q] = blk_latency_bucket_max(bucket) * ns_per_tick;
+                }
+
+                int last = LATENCY_BUCKETS - 1;
+                while (!merged[last])
+                {
+                    --last;
+                }
+
+                values[4] = blk_latency_bucket_max(last) * ns_per_tick;
+                length = snprintf(
+                    line, sizeof(line),
+                    "%-8s %-7s %-6s %12lu %10lu %10lu %10lu %10lu %10lu\n",
+                    op_names[op], path_names[path], class_names[cls],
+                    (unsigned long)total, (unsigned long)values[0],
+                    (unsigned long)values[1], (unsigned long)values[2],
+                    (unsigned long)values[3], (unsigned long)values[4]);
+                blk_latency_write(fd, line, length);
+            }
+        }
+    }
+}
+
+static void blk_latency_handler(int sig)
+{
+    (void)sig;
+    blk_latency_print(STDERR_FILENO);
+}
+
+void blk_latency_init(void)
+{
+    const blk_config *config = blk_config_get();
+    if (!config->latency)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    start_ticks = blk_latency_now();
+    blk_lock_init(&free_lock);
+    if (pthread_key_create(&thread_key, blk_latency_thread_exit))
+    {
+        return;
+    }
+
+    blk_latency_enabled = true;
+
+    // Print them on demand, for example with kill -USR2.
+    if (config->latency_signal)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = blk_latency_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(config->latency_signal, &action, NULL);
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/// @brief Macro that define the number of size classes of the histograms,
+/// each one 4 times larger than the previous one (up to 64, 256, ...).
+#define LATENCY_CLASSES 8
+
+/// @brief Macro that define the sub-buckets of each power of two, as a
+/// number of bits. 2 bits keep the error of a bucket under 25%.
+#define LATENCY_SUB_BITS 2
+
+/// @brief Macro that define the number of buckets, enough for 2^40 ticks.
+#define LATENCY_BUCKETS ((40 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+enum blk_latency_op
+{
+    LATENCY_MALLOC,
+    LATENCY_FREE,
+    LATENCY_REALLOC,
+    LATENCY_CALLOC,
+    LATENCY_OPS,
+};
+
+// Ordered by cost, the most expensive step taken by a call is kept.
+enum blk_latency_path
+{
+    // Served by the per-CPU cache, without lock
+    PATH_CACHE,
+    // Served by the free list or the slabs of an arena
+    PATH_LIST,
+    // A span was mapped or unmapped
+    PATH_EXTEND,
+    // At least mmap_threshold, with a span of its own
+    PATH_MMAP,
+    LATENCY_PATHS,
+};
+
+struct blk_latency_histograms
+{
+    // List of the histograms of every thread
+    struct blk_latency_histograms *next;
+
+    // List of the histograms of exited threads, reused by new ones
+    struct blk_latency_histograms *next_free;
+
+    uint32_t counts[LATENCY_OPS][LATENCY_PATHS][LATENCY_CLASSES]
+                   [LATENCY_BUCKETS];
+};
+
+/// @brief Tell if the calls are timed, read by the inline functions below.
+extern __attribute__((visibility("hidden"))) bool blk_latency_enabled;
+
+/// @brief Path taken by the call being timed on this thread.
+extern __thread __attribute__((visibility("hidden"))) int blk_latency_path
+    __attribute__((tls_model("initial-exec")));
+
+/// @brief Enable the histograms when requested by the configuration, and
+/// install the signal handler printing them.
+void blk_latency_init(void);
+
+/// @brief Read the clock of the histograms, the TSC on x86-64.
+/// @return The current time in ticks.
+static inline uint64_t blk_latency_now(void)
+{
+#if defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+/// @brief Start timing a call.
+/// @return The start time, 0 if the histograms are disabled.
+static inline uint64_t blk_latency_start(void)
+{
+    if (!blk_latency_enabled)
+    {
+        return 0;
+    }
+
+    blk_latency_path = PATH_CACHE;
+    return blk_latency_now();
+}
+
+/// @brief Note a step taken by the call being timed.
+/// @param path The step, kept if more expensive than the previous ones.
+static inline void blk_latency_note(int path)
+{
+    if (blk_latency_enabled && path > blk_latency_path)
+    {
+        blk_latency_path = path;
+    }
+}
+
+/// @brief Add a timed call to the histograms of the thread.
+/// @param op The operation.
+/// @param size The size of the block.
+/// @param start The value returned by blk_latency_start().
+void blk_latency_record(int op, size_t size, uint64_t start);
+
+/// @brief Write the merged histograms of every thread, one line per
+/// operation, path and size class with the percentiles in nanoseconds.
+/// Nothing is allocated while writing.
+/// @param fd The file descriptor to write to.
+void blk_latency_print(int fd);
+
+#endif /* ! LATENCY_H */
@@ -0,0 +1,242 @@
+#ifndef LIBMALLOC_H
+#define LIBMALLOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Allocate n blocks of the same size, taking the lock once.
+/// @param size The size of each block.
+/// @param n The number of blocks.
+/// @param out Array receiving the n pointers.
+/// @return n if it succeeded, 0 otherwise.
+size_t malloc_batch(size_t size, size_t n, void **out);
+
+/// @brief Free n blocks, taking the lock once per arena.
+/// @param ptrs The pointers to free, reordered by the call. NULL entries are
+/// skipped.
+/// @param n The number of pointers.
+void free_batch(void **ptrs, size_t n);
+
+/// @brief Write a binary snapshot of every arena to fd, one arena after the
+/// other, to be read by tools/analyze. Nothing is allocated while writing.
+/// @param fd The file descriptor to write to.
+/// @return 0 if it succeeded, -1 otherwise.
+int malloc_snapshot(int fd);
+
+/// @brief Write the configuration in use (BLK_MALLOC_CONF and the defaults),
+/// one key:value pair per line. Nothing is allocated while writing.
+/// @param fd The file descriptor to write to.
+void blk_config_print(int fd);
+
+/// @brief Write the latency histograms of malloc(), free(), realloc() and
+/// calloc(), per path and size class, with their percentiles in nanoseconds.
+/// Only filled with the latency option. Nothing is allocated while writing.
+/// @param fd The file descriptor to write to.
+void blk_latency_print(int fd);
+
+/// @brief Callback giving memory back when the allocator nears its budget.
+/// @param mapped The bytes mapped by the allocator.
+/// @param limit The hard limit, SIZE_MAX if none.
+/// @param arg The argument given at registration.
+typedef void (*blk_pressure_callback)(size_t mapped, size_t limit, void *arg);
+
+/// @brief Register a callback run once the allocator crossed its soft limit
+/// (memory.high, or 7/8 of memory.max or of the memory_limit option) and
+/// gave back its own cached memory. It may free and allocate.
+/// @param callback The callback.
+/// @param arg Passed to the callback.
+/// @return 0 if it succeeded, -1 if too many callbacks are registered.
+int blk_memory_pressure_register(blk_pressure_callback callback, void *arg);
+
+/// @brief Get the hard limit, past which allocations fail with ENOMEM.
+/// @return The limit in bytes, SIZE_MAX if none.
+size_t blk_memory_limit(void);
+
+/// @brief Get the bytes mapped by the allocator for its blocks, less the
+/// pages of free blocks trimmed since.
+/// @return The mapped bytes.
+size_t blk_memory_mapped(void);
+
+/// @brief Flag of blk_heap_reserve() faulting the reserved pages in.
+#define BLK_RESERVE_POPULATE 0x1
+
+/// @brief Flag of blk_heap_reserve() filling the per-CPU caches of every CPU
+/// the thread may run on.
+#define BLK_RESERVE_CACHES 0x2
+
+/// @brief Map memory for malloc() ahead of time, in the arena of the calling
+/// thread. It stays mapped even once all its blocks are freed. Also done at
+/// load time with the reserve, populate and warm_caches options.
+/// @param bytes The size to reserve, 0 to only apply the flags.
+/// @param flags BLK_RESERVE_POPULATE and BLK_RESERVE_CACHES, or 0.
+/// @return 0 if it succeeded, -1 otherwise.
+int blk_heap_reserve(size_t bytes, int flags);
+
+/// @brief Callback of blk_heap_iterate(), called on each block.
+/// @param ptr The block, as returned by malloc().
+/// @param size The bytes usable in the block.
+/// @param used 1 if the block is allocated, 0 if it is free.
+/// @param arg The argument given to blk_heap_iterate().
+typedef void (*blk_iterate_callback)(void *ptr, size_t size, int used,
+                                     void *arg);
+
+/// @brief Call a callback on every block of the arenas, allocated or free,
+/// span by span in the order they were mapped, then on the objects of their
+/// slabs and of the object caches. An arena or a cache is only locked while
+/// one span, slab or cache is recorded, the callback runs without any lock
+/// and may allocate and free, so each of them is seen as it was when
+/// recorded. Blocks held by the per-CPU caches and objects held by the
+/// magazines count as free. The objects a cache never handed out, the guard
+/// pool and the explicit heaps are not walked.
+/// @param callback The callback.
+/// @param arg Passed to the callback.
+/// @return 0 if it succeeded, -1 if out of memory.
+int blk_heap_iterate(blk_iterate_callback callback, void *arg);
+
+/// @brief Get the number of bytes the caller can use in a block.
+/// @param ptr A pointer returned by malloc() or blk_heap_malloc(), or NULL.
+/// @return The size of the block, at least the size requested.
+size_t blk_usable_size(void *ptr);
+
+/// @brief Opaque handle of an explicit heap.
+typedef struct blk_allocator blk_heap;
+
+/// @brief Create a heap independent from malloc() and the other heaps.
+/// @param size The size it should be able to hold directly.
+/// @return The heap, NULL on failure.
+blk_heap *blk_heap_create(size_t size);
+
+/// @brief Allocate a block in a heap.
+/// @param heap The heap.
+/// @param size The size of the block.
+/// @return A pointer to a region where the caller can write.
+void *blk_heap_malloc(blk_heap *heap, size_t size);
+
+/// @brief Free a block of a heap. free() and realloc() also accept the blocks
+/// of the heaps and keep them in their heap.
+/// @param heap The heap the block comes from.
+/// @param ptr The pointer to free.
+void blk_heap_free(blk_heap *heap, void *ptr);
+
+/// @brief Free every block of a heap at once, in O(pages). The heap keeps its
+/// first pages and can be used again.
+/// @param heap The heap.
+void blk_heap_reset(blk_heap *heap);
+
+/// @brief Write a binary snapshot of a heap to fd, as malloc_snapshot().
+/// @param heap The heap.
+/// @param fd The file descriptor to write to.
+/// @return 0 if it succeeded, -1 otherwise.
+int blk_heap_snapshot(blk_heap *heap, int fd);
+
+/// @brief Unmap a heap and all its blocks, in O(pages).
+/// @param heap The heap, it should not be used afterwards.
+void blk_heap_destroy(blk_heap *heap);
+
+/// @brief Opaque handle of an object cache.
+typedef struct blk_cache blk_cache;
+
+/// @brief Constructor or destructor of the objects of a cache.
+/// @param object The object.
+typedef void (*blk_cache_callback)(void *object);
+
+/// @brief Create a cache of objects of the same size. Objects are constructed
+/// once, the first time they are handed out, and stay constructed while free
+/// in the cache, so blk_cache_alloc() returns them as blk_cache_free() got
+/// them. Each thread keeps magazines of free objects taken and filled without
+/// any lock, in front of slabs shared by the threads.
+/// @param size The size of the objects.
+/// @param align Their alignment, a power of two up to the page size, 0 for
+/// the alignment of malloc().
+/// @param ctor Called on each object before it is first handed out, or NULL.
+/// @param dtor Called on each constructed object before its memory is
+/// unmapped, or NULL.
+/// @return The cache, NULL on failure.
+blk_cache *blk_cache_create(size_t size, size_t align, blk_cache_callback ctor,
+                            blk_cache_callback dtor);
+
+/// @brief Get a constructed object from a cache.
+/// @param cache The cache.
+/// @return The object, NULL if out of memory.
+void *blk_cache_alloc(blk_cache *cache);
+
+/// @brief Give an object back to its cache, in the state it should be handed
+/// out next. free() and realloc() also accept the objects.
+/// @param cache The cache the object comes from.
+/// @param object The object, or NULL.
+void blk_cache_free(blk_cache *cache, void *object);
+
+/// @brief Destruct the free objects of a cache and unmap it. The objects
+/// still in use are unmapped without being destructed.
+/// @param cache The cache, no thread should use it anymore.
+void blk_cache_destroy(blk_cache *cache);
+
+/// @brief Opaque handle of a shared heap, the start of its mapping.
+typedef struct blk_shared_heap blk_shared_heap;
+
+/// @brief Format a file as a heap and map it shared. Its blocks are linked by
+/// offsets, so every process mapping the file uses the same heap whatever
+/// its address, and it can be mapped again with blk_shared_heap_open() after
+/// a restart. For memory shared between processes only, fd can come from
+/// memfd_create(). The caller keeps fd.
+/// @param fd A file open for reading and writing, resized to size.
+/// @param size The size of the heap, rounded up to whole pages.
+/// @return The heap, NULL on failure.
+blk_shared_heap *blk_shared_heap_create(int fd, size_t size);
+
+/// @brief Map a heap created by blk_shared_heap_create(), in another process
+/// or after a restart. Its blocks are checked first. A process that died
+/// while holding its lock leaves it locked.
+/// @param fd The file of the heap, open for reading and writing.
+/// @return The heap, NULL if fd does not hold a valid heap.
+blk_shared_heap *blk_shared_heap_open(int fd);
+
+/// @brief Allocate a block in a shared heap, visible to every process mapping
+/// it. free() does not accept these blocks.
+/// @param heap The heap.
+/// @param size The size of the block.
+/// @return A pointer valid in this process, NULL if the heap is full.
+void *blk_shared_heap_malloc(blk_shared_heap *heap, size_t size);
+
+/// @brief Free a block of a shared heap, from any process mapping it.
+/// @param heap The heap.
+/// @param ptr The pointer to free, as seen by this process.
+void blk_shared_heap_free(blk_shared_heap *heap, void *ptr);
+
+/// @brief Get the offset of a pointer from the start of a shared heap, to be
+/// stored in the heap or sent to another process.
+/// @param heap The heap.
+/// @param ptr A pointer in the heap, or NULL.
+/// @return The offset, 0 for NULL.
+size_t blk_shared_heap_offset(blk_shared_heap *heap, const void *ptr);
+
+/// @brief Get the pointer of an offset from the start of a shared heap.
+/// @param heap The heap.
+/// @param offset An offset from blk_shared_heap_offset(), or 0.
+/// @return The pointer in this process, NULL for 0.
+void *blk_shared_heap_pointer(blk_shared_heap *heap, size_t offset);
+
+/// @brief Record the block the data of the heap is reached from, read back
+/// with blk_shared_heap_root() once the heap is opened again.
+/// @param heap The heap.
+/// @param ptr A block of the heap, or NULL.
+void blk_shared_heap_set_root(blk_shared_heap *heap, void *ptr);
+
+/// @brief Get the block recorded by blk_shared_heap_set_root().
+/// @param heap The heap.
+/// @return The block, NULL if none was recorded.
+void *blk_shared_heap_root(blk_shared_heap *heap);
+
+/// @brief Unmap a shared heap from this process. Its blocks stay in the file
+/// and in the other processes.
+/// @param heap The heap, it should not be used afterwards.
+void blk_shared_heap_close(blk_shared_heap *heap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! LIBMALLOC_H */
@@ -0,0 +1,367 @@
+#include "limit.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "libmalloc.h"
+#include "lock.h"
+#include "thread.h"
+
+/// @brief Macro that define the longest cgroup directory path handled.
+#define LIMIT_PATH_SIZE 512
+
+// Files of the memory controller, cgroup v2 first.
+struct blk_cgroup_files
+{
+    const char *root;
+    const char *max;
+    const char *high;
+    const char *current;
+};
+
+static const struct blk_cgroup_files cgroup_versions[] = {
+    { "/sys/fs/cgroup", "memory.max", "memory.high", "memory.current" },
+    { "/sys/fs/cgroup/memory", "memory.limit_in_bytes",
+      "memory.soft_limit_in_bytes", "memory.usage_in_bytes" },
+};
+
+struct blk_pressure_entry
+{
+    blk_pressure_callback callback;
+    void *arg;
+};
+
+// Budget, SIZE_MAX when unlimited.
+static size_t hard_limit = SIZE_MAX;
+static size_t soft_limit = SIZE_MAX;
+
+// Bytes mapped by the allocator.
+static size_t mapped;
+
+static bool pressure;
+static bool reclaiming;
+
+static struct blk_pressure_entry callbacks[LIMIT_MAX_CALLBACKS];
+static int callback_count;
+static blk_lock callbacks_lock;
+
+static pthread_once_t limit_once = PTHREAD_ONCE_INIT;
+
+// Cgroup directory of the process, and its files, NULL if not found.
+static char cgroup_dir[LIMIT_PATH_SIZE];
+static const struct blk_cgroup_files *cgroup_files;
+
+static bool blk_limit_read(const char *dir, const char *name, size_t *value)
+{
+    // Read without allocating, malloc may be the caller.
+    char path[LIMIT_PATH_SIZE + 64];
+    size_t dir_length = strlen(dir);
+    size_t name_length = strlen(name);
+    if (dir_length + name_length + 2 > sizeof(path))
+    {
+        return false;
+    }
+
+    memcpy(path, dir, dir_length);
+    path[dir_length] = '/';
+    memcpy(path + dir_length + 1, name, name_length + 1);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char buffer[32];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    // "max" in v2, a huge page aligned number in v1.
+    buffer[length] = '\0';
+    unsigned long long number = strtoull(buffer, NULL, 10);
+    *value = !strncmp(buffer, "max", 3) || number >= (1ULL << 62)
+        ? SIZE_MAX
+        : (size_t)number;
+    return true;
+}
+
+static bool blk_limit_find_cgroup(void)
+{
+    int fd = open("/proc/self/cgroup", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char buffer[4096];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    buffer[length] = '\0';
+
+    // "0::/path" for v2, "N:memory:/path" for the v1 memory controller.
+    const char *prefixes[] = { "0::", ":memory:" };
+    for (size_t version = 0; version < 2; ++version)
+    {
+        const char *line = strstr(buffer, prefixes[version]);
+        if (!line || (version == 0 && line != buffer && line[-1] != '\n'))
+        {
+            continue;
+        }
+
+        const char *path = line + strlen(prefixes[version]);
+        size_t path_length = strcspn(path, "\n");
+        const struct blk_cgroup_files *files = &cgroup_versions[version];
+        size_t root_length = strlen(files->root);
+        if (root_length + path_length >= sizeof(cgroup_dir))
+        {
+            continue;
+        }
+
+        memcpy(cgroup_dir, files->root, root_length);
+        memcpy(cgroup_dir + root_length, path, path_length);
+        cgroup_dir[root_length + path_length] = '\0';
+
+        // Inside a cgroup namespace the path may not exist, the root of
+        // the mount is then the cgroup of the process.
+        size_t value;
+        if (!blk_limit_read(cgroup_dir, files->current, &value))
+        {
+            cgroup_dir[root_length] = '\0';
+        }
+
+        if (blk_limit_read(cgroup_dir, files->current, &value))
+        {
+            cgroup_files = files;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void blk_limit_read_cgroup(size_t *max, size_t *high)
+{
+    // The limits of the parents apply too.
+    char dir[LIMIT_PATH_SIZE];
+    memcpy(dir, cgroup_dir, sizeof(dir));
+    size_t root_length = strlen(cgroup_files->root);
+    while (true)
+    {
+        size_t value;
+        if (blk_limit_read(dir, cgroup_files->max, &value) && value < *max)
+        {
+            *max = value;
+        }
+
+        if (blk_limit_read(dir, cgroup_files->high, &value) && value < *high)
+        {
+            *high = value;
+        }
+
+        char *slash = strrchr(dir, '/');
+        if (strlen(dir) <= root_length || !slash)
+        {
+            break;
+        }
+
+        *slash = '\0';
+    }
+}
+
+static void blk_limit_update(void)
+{
+    size_t max = blk_config_get()->memory_limit;
+    size_t high = SIZE_MAX;
+    max = max ? max : SIZE_MAX;
+    if (cgroup_files)
+    {
+        blk_limit_read_cgroup(&max, &high);
+    }
+
+    // Without memory.high, start giving memory back at 7/8 of the limit.
+    if (max != SIZE_MAX && max - max / 8 < high)
+    {
+        high = max - max / 8;
+    }
+
+    __atomic_store_n(&hard_limit, max, __ATOMIC_RELAXED);
+    __atomic_store_n(&soft_limit, high, __ATOMIC_RELAXED);
+}
+
+static void blk_limit_update_usage(void)
+{
+    size_t usage;
+    if (!cgroup_files || !blk_config_get()->limit_interval
+        || !blk_limit_read(cgroup_dir, cgroup_files->current, &usage))
+    {
+        return;
+    }
+
+    // Other processes and the page cache of the cgroup count as well, but
+    // the kernel can reclaim the cache, so only give memory back.
+    if (usage > __atomic_load_n(&soft_limit, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&pressure, true, __ATOMIC_RELAXED);
+    }
+}
+
+static void blk_limit_load(void)
+{
+    blk_limit_find_cgroup();
+    blk_limit_update();
+    blk_limit_update_usage();
+}
+
+void blk_limit_init(void)
+{
+    pthread_once(&limit_once, blk_limit_load);
+}
+
+bool blk_limit_charge(size_t size)
+{
+    size_t total = __atomic_add_fetch(&mapped, size, __ATOMIC_RELAXED);
+
+    // Fail the mapping instead of waiting for the OOM killer.
+    if (total > __atomic_load_n(&hard_limit, __ATOMIC_RELAXED))
+    {
+        __atomic_sub_fetch(&mapped, size, __ATOMIC_RELAXED);
+        __atomic_store_n(&pressure, true, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    if (total > __atomic_load_n(&soft_limit, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&pressure, true, __ATOMIC_RELAXED);
+    }
+
+    return true;
+}
+
+void blk_limit_uncharge(size_t size)
+{
+    __atomic_sub_fetch(&mapped, size, __ATOMIC_RELAXED);
+}
+
+void blk_limit_recharge(size_t size)
+{
+    size_t total = __atomic_add_fetch(&mapped, size, __ATOMIC_RELAXED);
+    if (total > __atomic_load_n(&soft_limit, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&pressure, true, __ATOMIC_RELAXED);
+    }
+}
+
+bool blk_limit_pressure(void)
+{
+    return __atomic_load_n(&pressure, __ATOMIC_RELAXED);
+}
+
+bool blk_limit_begin_reclaim(void)
+{
+    // Callbacks allocating while reclaiming do not reclaim again.
+    if (__atomic_exchange_n(&reclaiming, true, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    __atomic_store_n(&pressure, false, __ATOMIC_RELAXED);
+    return true;
+}
+
+void blk_limit_end_reclaim(void)
+{
+    // Copy the callbacks so they run without the lock.
+    struct blk_pressure_entry copy[LIMIT_MAX_CALLBACKS];
+    blk_lock_acquire(&callbacks_lock);
+    int count = callback_count;
+    memcpy(copy, callbacks, count * sizeof(*copy));
+    blk_lock_release(&callbacks_lock);
+
+    size_t total = __atomic_load_n(&mapped, __ATOMIC_RELAXED);
+    size_t max = __atomic_load_n(&hard_limit, __ATOMIC_RELAXED);
+    for (int i = 0; i < count; ++i)
+    {
+        copy[i].callback(total, max, copy[i].arg);
+    }
+
+    blk_limit_update_usage();
+    __atomic_store_n(&reclaiming, false, __ATOMIC_RELEASE);
+}
+
+__attribute__((visibility("default"))) int
+blk_memory_pressure_register(blk_pressure_callback callback, void *arg)
+{
+    int registered = -1;
+
+    // Lock the callbacks.
+    blk_lock_acquire(&callbacks_lock);
+
+    if (callback_count < LIMIT_MAX_CALLBACKS)
+    {
+        callbacks[callback_count].callback = callback;
+        callbacks[callback_count].arg = arg;
+        ++callback_count;
+        registered = 0;
+    }
+
+    // Unlock the callbacks.
+    blk_lock_release(&callbacks_lock);
+
+    return registered;
+}
+
+__attribute__((visibility("default"))) size_t blk_memory_limit(void)
+{
+    // Read it first if nothing was allocated yet.
+    blk_limit_init();
+    return __atomic_load_n(&hard_limit, __ATOMIC_RELAXED);
+}
+
+__attribute__((visibility("default"))) size_t blk_memory_mapped(void)
+{
+    return __atomic_load_n(&mapped, __ATOMIC_RELAXED);
+}
+
+static void *blk_limit_routine(void *arg)
+{
+    struct timespec *interval = arg;
+    while (true)
+    {
+        nanosleep(interval, NULL);
+        blk_limit_update();
+        blk_limit_update_usage();
+    }
+
+    return NULL;
+}
+
+__attribute__((constructor)) static void blk_limit_start_thread(void)
+{
+    // Polling is opt-in, the limits are otherwise read once.
+    size_t ms = blk_config_get()->limit_interval;
+    if (!ms)
+    {
+        return;
+    }
+
+    static struct timespec interval;
+    interval.tv_sec = ms / 1000;
+    interval.tv_nsec = (ms % 1000) * 1000000;
+
+    blk_start_thread(blk_limit_routine, &interval);
+}
@@ -0,0 +1,43 @@
+#ifndef LIMIT_H
+#define LIMIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// @brief Macro that define the most pressure callbacks registered at once.
+#define LIMIT_MAX_CALLBACKS 16
+
+/// @brief Read the memory budget: memory.max and memory.high of the cgroup
+/// (cgroup v2, or their v1 equivalents), lowered by memory_limit from the
+/// configuration. Without any, mappings are only counted.
+void blk_limit_init(void);
+
+/// @brief Count a mapping against the budget before it is made. Crossing the
+/// soft limit raises the pressure flag.
+/// @param size The size of the mapping.
+/// @return true if it fits, false if it would go past the hard limit.
+bool blk_limit_charge(size_t size);
+
+/// @brief Give back the size of a mapping, once unmapped or not made.
+/// @param size The size of the mapping.
+void blk_limit_uncharge(size_t size);
+
+/// @brief Count the size of pages given back without being unmapped, once
+/// they are used again. It does not fail, they are already mapped.
+/// @param size The size of the pages.
+void blk_limit_recharge(size_t size);
+
+/// @brief Tell if memory should be given back, checked by the slow paths
+/// once they released their lock.
+/// @return true if the soft limit was crossed since the last reclaim.
+bool blk_limit_pressure(void);
+
+/// @brief Elect the thread running the reclaim, the others go on.
+/// @return true if the caller should reclaim and call blk_limit_end_reclaim().
+bool blk_limit_begin_reclaim(void);
+
+/// @brief Call the callbacks registered by the application, then read the
+/// usage of the cgroup again.
+void blk_limit_end_reclaim(void);
+
+#endif /* ! LIMIT_H */
@@ -0,0 +1,105 @@
+#include "lock.h"
+
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "probe.h"
+
+/// @brief Macro to hint the CPU that we are in a spin loop.
+#if defined(__x86_64__) || defined(__i386__)
+#    define CPU_RELAX() __builtin_ia32_pause()
+#else
+#    define CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+// Metrics are not updated while disabled.
+static bool stats_enabled = true;
+
+static uint64_t blk_lock_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static bool blk_lock_try(blk_lock *lock)
+{
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n(&lock->state, &expected, 1, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void blk_lock_set_stats(bool enabled)
+{
+    stats_enabled = enabled;
+}
+
+void blk_lock_init(blk_lock *lock)
+{
+    lock->state = 0;
+    lock->shared = false;
+    lock->acquisitions = 0;
+    lock->contended = 0;
+    lock->wait_ns = 0;
+}
+
+void blk_lock_init_shared(blk_lock *lock)
+{
+    blk_lock_init(lock);
+    lock->shared = true;
+}
+
+void blk_lock_acquire(blk_lock *lock)
+{
+    // Fast path, the lock is free.
+    if (blk_lock_try(lock))
+    {
+        lock->acquisitions += stats_enabled;
+        return;
+    }
+
+    BLK_PROBE1(lock__contended, lock);
+    uint64_t start = stats_enabled ? blk_lock_now() : 0;
+
+    // Critical sections are short, the holder is likely done soon.
+    bool acquired = false;
+    for (int i = 0; i < LOCK_SPINS && !acquired; ++i)
+    {
+        CPU_RELAX();
+        acquired = __atomic_load_n(&lock->state, __ATOMIC_RELAXED) == 0
+            && blk_lock_try(lock);
+    }
+
+    // Sleep, marking the lock so the holder knows it has to wake us.
+    if (!acquired)
+    {
+        while (__atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE) != 0)
+        {
+            syscall(SYS_futex, &lock->state,
+                    lock->shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, 2, NULL,
+                    NULL, 0);
+        }
+    }
+
+    if (stats_enabled)
+    {
+        lock->acquisitions += 1;
+        lock->contended += 1;
+        lock->wait_ns += blk_lock_now() - start;
+    }
+
+    BLK_PROBE2(lock__acquired, lock, !acquired);
+}
+
+void blk_lock_release(blk_lock *lock)
+{
+    if (__atomic_exchange_n(&lock->state, 0, __ATOMIC_RELEASE) == 2)
+    {
+        syscall(SYS_futex, &lock->state,
+                lock->shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, 1, NULL, NULL,
+                0);
+    }
+}
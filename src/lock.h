@@ -0,0 +1,49 @@
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// @brief Macro that define how many times a thread spins before sleeping.
+#define LOCK_SPINS 128
+
+struct blk_lock
+{
+    // 0 when free, 1 when held, 2 when held with sleeping waiters
+    uint32_t state;
+
+    // Set when the lock lives in memory shared between processes
+    bool shared;
+
+    // Contention metrics, only updated by the holder
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_ns;
+};
+
+typedef struct blk_lock blk_lock;
+
+/// @brief Initialize the lock as free with empty metrics.
+/// @param lock The lock.
+void blk_lock_init(blk_lock *lock);
+
+/// @brief Initialize a lock placed in memory shared between processes, their
+/// threads sleep and wake on its address instead of a private futex.
+/// @param lock The lock.
+void blk_lock_init_shared(blk_lock *lock);
+
+/// @brief Turn the contention metrics of every lock on or off. They are on by
+/// default, turning them off saves two clock reads per contended acquisition.
+/// @param enabled true to count, false otherwise.
+void blk_lock_set_stats(bool enabled);
+
+/// @brief Take the lock. Spin a little with pause first, then sleep on a
+/// futex until it is released.
+/// @param lock The lock.
+void blk_lock_acquire(blk_lock *lock);
+
+/// @brief Release the lock and wake a sleeping waiter if any.
+/// @param lock The lock.
+void blk_lock_release(blk_lock *lock);
+
+#endif /* ! LOCK_H */
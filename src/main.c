@@ -2,6 +2,7 @@
 
 #define P1_SIZE 1000
 #define P2_SIZE 5000
+#define BATCH_SIZE 16
 
 int main(void)
 {
@@ -75,12 +76,24 @@ int main(void)
         goto error;
     }
 
+    // Malloc a batch.
+    void *batch[BATCH_SIZE];
+    size_t count = blk_malloc_batch(&blka, P1_SIZE, BATCH_SIZE, batch);
+
+    // Snapshot 6.
+    if (count != BATCH_SIZE || !utilities_blka_snapshot(&blka))
+    {
+        PRINT_ERROR("blk_malloc_batch or utilities_blka_snapshot failed.");
+        goto error;
+    }
+
     // Free all.
+    blk_free_batch(&blka, batch, BATCH_SIZE);
     blk_free(&blka, p1);
     blk_free(&blka, p2);
     blk_free(&blka, p3);
 
-    // Snapshot 6.
+    // Snapshot 7.
     if (!utilities_blka_snapshot(&blka))
     {
         PRINT_ERROR("utilities_blka_snapshot failed.");
@@ -1,116 +1,941 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "allocator.h"
+#include "cache.h"
+#include "config.h"
+#include "copy.h"
+#include "guard.h"
+#include "iterate.h"
+#include "latency.h"
+#include "libmalloc.h"
+#include "limit.h"
+#include "numa.h"
+#include "pagemap.h"
+#include "percpu.h"
+#include "probe.h"
+#include "slab.h"
+#include "snapshot.h"
+#include "thread.h"
 
-// Global allocator.
-static blk_allocator blka;
+// Entry points of glibc malloc, for the pointers it handed out. They are weak
+// so a static link against libmalloc.a does not pull glibc malloc in, there
+// is then no foreign pointer and they stay NULL.
+__attribute__((weak)) void __libc_free(void *ptr);
+__attribute__((weak)) void *__libc_realloc(void *ptr, size_t size);
 
-__attribute__((visibility("default"))) void *malloc(size_t size)
+/// @brief Macro that define the highest number of arenas.
+#define MAX_ARENAS NUMA_MAX_NODES
+
+/// @brief Macro that define the most blocks moving between a CPU cache and an
+/// arena at once, half of the slots of a class.
+#define PERCPU_BATCH (PERCPU_SLOTS / 2)
+
+// Global arenas, one per NUMA node by default.
+static blk_allocator arenas[MAX_ARENAS];
+static int arena_count;
+static int node_count;
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+
+static void blk_init_arenas(void)
 {
-    // Check if we need to create an allocator.
-    if (!blka.meta)
+    // Checksums are turned off before any block is written.
+    const blk_config *config = blk_config_get();
+    blk_set_checksums(config->integrity != INTEGRITY_NONE);
+    blk_lock_set_stats(config->stats);
+    blk_limit_init();
+    blk_copy_init();
+
+    // Arena i serves node i modulo the number of nodes.
+    int nodes = blk_numa_node_count();
+    int count = config->arenas ? (int)config->arenas : nodes;
+    if (config->arenas > MAX_ARENAS)
     {
-        blk_init_allocator(&blka, size);
+        count = MAX_ARENAS;
     }
 
-    // Lock the mutex.
-    pthread_mutex_lock(&blka.lock);
+    // Only bind the pages when there is more than one node.
+    for (int i = 0; i < count; ++i)
+    {
+        blk_init_arena(&arenas[i], 0, i, nodes > 1 ? i % nodes : -1);
+    }
 
-    // Call blk_malloc.
-    void *ptr = blk_malloc(&blka, size);
+    arena_count = count;
+    node_count = nodes;
+    blk_slab_init();
+    blk_percpu_init();
+    blk_guard_init();
+    blk_latency_init();
+}
 
-    // Unlock the mutex.
-    pthread_mutex_unlock(&blka.lock);
+static blk_allocator *blk_arena_get(void)
+{
+    // Check if we need to create the arenas.
+    pthread_once(&arenas_once, blk_init_arenas);
 
-    return ptr;
+    if (arena_count == 1)
+    {
+        return &arenas[0];
+    }
+
+    // Use an arena of the node the thread runs on, picked by CPU when the
+    // node has several. The arenas index, index + node_count... serve the
+    // node, so the first nodes get one more when the count is not a multiple.
+    int index = blk_numa_current_node() % arena_count;
+    if (arena_count > node_count)
+    {
+        int per_node = (arena_count - index + node_count - 1) / node_count;
+        index += node_count * (blk_numa_current_cpu() % per_node);
+    }
+
+    return &arenas[index];
 }
 
-__attribute__((visibility("default"))) void free(void *ptr)
+static blk_allocator *blk_owner_of(void *ptr)
+{
+    // Pointers of other allocators are not in the page map.
+    blk_span *span = blk_pagemap_get(ptr);
+    return span ? span->owner : NULL;
+}
+
+static blk_allocator *blk_arena_of(void *ptr)
 {
-    // Check if we need to create an allocator.
-    if (!blka.meta)
+    // Objects of the slabs are found through their descriptor.
+    blk_slab *slab = blk_slab_of(ptr);
+    return slab ? slab->owner : blk_owner_of(ptr);
+}
+
+static void blk_foreign_free(void *ptr)
+{
+    // Objects of the caches go back constructed, sampled blocks live in the
+    // guarded pool, the others come from glibc.
+    blk_cache_slab *cache_slab = blk_cache_slab_of(ptr);
+    if (cache_slab)
     {
-        blk_init_allocator(&blka, 0);
+        blk_cache_free(cache_slab->cache, ptr);
     }
+    else if (blk_guard_owns(ptr))
+    {
+        blk_guard_free(ptr);
+    }
+    else if (__libc_free)
+    {
+        __libc_free(ptr);
+    }
+}
+
+static void blk_arena_free(void **ptrs, size_t count)
+{
+    size_t start = 0;
+    while (start < count)
+    {
+        if (!ptrs[start])
+        {
+            ++start;
+            continue;
+        }
 
-    // Lock the mutex.
-    pthread_mutex_lock(&blka.lock);
+        blk_allocator *blka = blk_arena_of(ptrs[start]);
+        if (!blka)
+        {
+            blk_foreign_free(ptrs[start++]);
+            continue;
+        }
 
-    // Call blk_free.
-    blk_free(&blka, ptr);
+        // Move the blocks of the same arena to the front.
+        size_t end = start + 1;
+        for (size_t i = end; i < count; ++i)
+        {
+            if (ptrs[i] && blk_arena_of(ptrs[i]) == blka)
+            {
+                void *temp = ptrs[i];
+                ptrs[i] = ptrs[end];
+                ptrs[end++] = temp;
+            }
+        }
 
-    // Unlock the mutex.
-    pthread_mutex_unlock(&blka.lock);
+        // Lock the arena.
+        blk_lock_acquire(&blka->lock);
+        blk_latency_note(PATH_LIST);
+
+        // Call blk_slab_free on the objects, blk_free_batch on the blocks.
+        size_t blocks = start;
+        for (size_t i = start; i < end; ++i)
+        {
+            blk_slab *slab = blk_slab_of(ptrs[i]);
+            if (slab)
+            {
+                blk_slab_free(slab, ptrs[i]);
+            }
+            else
+            {
+                ptrs[blocks++] = ptrs[i];
+            }
+        }
+
+        blk_free_batch(blka, ptrs + start, blocks - start);
+
+        // Unlock the arena.
+        blk_lock_release(&blka->lock);
+
+        start = end;
+    }
 }
 
-__attribute__((visibility("default"))) void *realloc(void *ptr, size_t size)
+static bool blk_memory_reclaim(void)
 {
-    // Check if we need to create an allocator.
-    if (!blka.meta)
+    // A single thread reclaims at a time, the others go on.
+    if (!blk_limit_begin_reclaim())
     {
-        blk_init_allocator(&blka, size);
+        return false;
     }
 
-    // Lock the mutex.
-    pthread_mutex_lock(&blka.lock);
+    // Give back the blocks cached by every CPU.
+    blk_percpu_drain(blk_arena_free);
+
+    for (int i = 0; i < arena_count; ++i)
+    {
+        // Lock the arena.
+        blk_lock_acquire(&arenas[i].lock);
+
+        // Call blk_release_retained, then blk_trim on the free blocks left.
+        blk_release_retained(&arenas[i]);
+        blk_trim(&arenas[i], 0);
+
+        // Unlock the arena.
+        blk_lock_release(&arenas[i].lock);
+    }
+
+    // Let the application drop its own caches.
+    blk_limit_end_reclaim();
+    return true;
+}
+
+static void *blk_arena_malloc(size_t size)
+{
+    blk_allocator *blka = blk_arena_get();
+    int cls = blk_slab_enabled() ? blk_percpu_class_of(size) : -1;
+
+    void *ptr = NULL;
+    for (int attempt = 0; attempt < 2 && !ptr; ++attempt)
+    {
+        // Lock the arena.
+        blk_lock_acquire(&blka->lock);
+        blk_latency_note(PATH_LIST);
+
+        // Call blk_slab_malloc or blk_malloc.
+        ptr = cls >= 0 ? blk_slab_malloc(blka, cls) : blk_malloc(blka, size);
+
+        // Unlock the arena.
+        blk_lock_release(&blka->lock);
+
+        // Give memory back past the soft limit, a failure is tried again
+        // once it was.
+        if (!blk_limit_pressure() || !blk_memory_reclaim())
+        {
+            break;
+        }
+    }
 
-    // If no ptr, realloc = malloc.
     if (!ptr)
     {
-        // Call blk_malloc.
-        ptr = blk_malloc(&blka, size);
+        errno = ENOMEM;
+    }
+
+    return ptr;
+}
 
-        // Unlock the mutex.
-        pthread_mutex_unlock(&blka.lock);
+__attribute__((noinline)) static void *blk_percpu_refill(int cls)
+{
+    blk_allocator *blka = blk_arena_get();
+    size_t size = blk_percpu_class_size(cls);
+    size_t batch = blk_percpu_slots() / 2 ? blk_percpu_slots() / 2 : 1;
+    void *ptrs[PERCPU_BATCH];
+
+    // Lock the arena.
+    blk_lock_acquire(&blka->lock);
+    blk_latency_note(PATH_LIST);
+
+    // Allocate a batch of blocks, the first one is for the caller.
+    size_t count = blk_slab_enabled()
+        ? blk_slab_malloc_batch(blka, cls, batch, ptrs)
+        : blk_malloc_batch(blka, size, batch, ptrs);
 
+    // Unlock the arena.
+    blk_lock_release(&blka->lock);
+
+    if (blk_limit_pressure())
+    {
+        blk_memory_reclaim();
+    }
+
+    // Cache the others, give them back if the cache filled up meanwhile.
+    size_t i = 1;
+    while (i < count && blk_percpu_push(cls, ptrs[i]))
+    {
+        ++i;
+    }
+
+    if (i < count)
+    {
+        blk_arena_free(ptrs + i, count - i);
+    }
+
+    return count ? ptrs[0] : NULL;
+}
+
+static inline void *blk_malloc_entry(size_t size)
+{
+    // A few allocations are placed in the guarded pool.
+    void *ptr = blk_guard_malloc(size);
+    if (ptr)
+    {
         return ptr;
     }
 
+    // Serve small requests from the cache of the current CPU.
+    int cls = blk_percpu_class_of(size);
+    if (cls >= 0)
+    {
+        ptr = blk_percpu_pop(cls);
+        if (ptr)
+        {
+            return ptr;
+        }
+
+        // Check if we need to create the arenas.
+        pthread_once(&arenas_once, blk_init_arenas);
+        ptr = blk_percpu_enabled() ? blk_percpu_refill(cls) : NULL;
+        if (ptr)
+        {
+            return ptr;
+        }
+    }
+
+    return blk_arena_malloc(size);
+}
+
+static inline void blk_free_entry(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    // The class of a slab object is in its descriptor, away from the data.
+    blk_slab *slab = blk_slab_of(ptr);
+    int cls = slab ? slab->cls : -1;
+    if (!slab)
+    {
+        blk_allocator *blka = blk_owner_of(ptr);
+        if (!blka)
+        {
+            blk_foreign_free(ptr);
+            return;
+        }
+
+        // Keep small blocks of the arenas in the cache of the current CPU,
+        // unless the caches hold slab objects.
+        uint8_t *ptr_p = ptr;
+        ptr_p -= sizeof(blk_meta);
+        void *temp = ptr_p;
+        blk_meta *blk = temp;
+        if (blka->id != HEAP_ARENA && !blk_slab_enabled())
+        {
+            cls = blk_percpu_class_of_block(blk->size);
+        }
+    }
+
+    // A block freed twice may still be cached, it is not cached again so it
+    // is not handed out twice.
+    if (cls >= 0 && blk_percpu_is_cached(cls, ptr))
+    {
+        return;
+    }
+
+    if (cls >= 0 && blk_percpu_push(cls, ptr))
+    {
+        return;
+    }
+
+    // The cache is full, make room by giving back part of it.
+    void *ptrs[PERCPU_BATCH + 1];
+    size_t batch = blk_percpu_slots() / 2;
+    size_t count = 0;
+    ptrs[count++] = ptr;
+    while (cls >= 0 && count <= batch
+           && (ptrs[count] = blk_percpu_pop(cls)))
+    {
+        ++count;
+    }
+
+    // Free them in the arenas they come from.
+    blk_arena_free(ptrs, count);
+}
+
+static inline void *blk_realloc_entry(void *ptr, size_t size)
+{
+    // If no ptr, realloc = malloc.
+    if (!ptr)
+    {
+        return blk_malloc_entry(size);
+    }
+
     // If size = 0, realloc = free.
     if (!size)
     {
-        // Call blk_free.
-        blk_free(&blka, ptr);
+        blk_free_entry(ptr);
+        return NULL;
+    }
+
+    // Slab objects keep their size, they move when it is too small.
+    blk_slab *slab = blk_slab_of(ptr);
+    if (slab && size <= blk_slab_size(slab))
+    {
+        return ptr;
+    }
+    else if (slab)
+    {
+        void *new_ptr = blk_malloc_entry(size);
+        if (new_ptr)
+        {
+            memcpy(new_ptr, ptr, blk_slab_size(slab));
+            blk_free_entry(ptr);
+        }
 
-        // Unlock the mutex.
-        pthread_mutex_unlock(&blka.lock);
+        return new_ptr;
+    }
 
+    // Objects of the caches move to the arenas when they grow.
+    blk_cache_slab *cache_slab = blk_cache_slab_of(ptr);
+    if (cache_slab && size <= cache_slab->cache->stride)
+    {
         return ptr;
     }
+    else if (cache_slab)
+    {
+        void *new_ptr = blk_malloc_entry(size);
+        if (new_ptr)
+        {
+            memcpy(new_ptr, ptr, cache_slab->cache->stride);
+            blk_cache_free(cache_slab->cache, ptr);
+        }
+
+        return new_ptr;
+    }
+
+    // Reallocate it in the arena it comes from.
+    blk_allocator *blka = blk_owner_of(ptr);
+    if (!blka && blk_guard_owns(ptr))
+    {
+        // Move sampled blocks out of the pool.
+        void *new_ptr = blk_malloc_entry(size);
+        size_t old_size = blk_guard_size(ptr);
+        if (new_ptr)
+        {
+            memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+            blk_guard_free(ptr);
+        }
+
+        return new_ptr;
+    }
+    else if (!blka)
+    {
+        return __libc_realloc ? __libc_realloc(ptr, size) : NULL;
+    }
+
+    void *new_ptr = NULL;
+    for (int attempt = 0; attempt < 2 && !new_ptr; ++attempt)
+    {
+        // Lock the arena.
+        blk_lock_acquire(&blka->lock);
+        blk_latency_note(PATH_LIST);
 
-    // Call blk_realloc.
-    ptr = blk_realloc(&blka, ptr, size);
+        // Call blk_realloc, the block is left as is on failure.
+        new_ptr = blk_realloc(blka, ptr, size);
 
-    // Unlock the mutex.
-    pthread_mutex_unlock(&blka.lock);
+        // Unlock the arena.
+        blk_lock_release(&blka->lock);
+
+        if (!blk_limit_pressure() || !blk_memory_reclaim())
+        {
+            break;
+        }
+    }
+
+    if (!new_ptr)
+    {
+        errno = ENOMEM;
+    }
+
+    return new_ptr;
+}
+
+static inline void *blk_calloc_entry(size_t nmemb, size_t size)
+{
+    // Check for an overflow.
+    size_t total_size;
+    if (__builtin_mul_overflow(nmemb, size, &total_size))
+    {
+        // If it overflows, return null.
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Set all bytes to 0 outside of the lock.
+    void *ptr = blk_malloc_entry(total_size);
+    if (ptr)
+    {
+        blk_zero(ptr, total_size);
+    }
 
     return ptr;
 }
 
+__attribute__((visibility("default"))) void *malloc(size_t size)
+{
+    BLK_PROBE1(malloc__entry, size);
+
+    // Time the call when the histograms are enabled.
+    uint64_t start = blk_latency_start();
+    void *ptr = blk_malloc_entry(size);
+    if (start)
+    {
+        blk_latency_record(LATENCY_MALLOC, size, start);
+    }
+
+    BLK_PROBE2(malloc__return, ptr, size);
+    return ptr;
+}
+
+__attribute__((visibility("default"))) void free(void *ptr)
+{
+    BLK_PROBE1(free__entry, ptr);
+
+    if (!blk_latency_enabled)
+    {
+        blk_free_entry(ptr);
+        BLK_PROBE1(free__return, ptr);
+        return;
+    }
+
+    // The size is read before the block is gone, outside of the timing.
+    size_t size = blk_usable_size(ptr);
+    uint64_t start = blk_latency_start();
+    blk_free_entry(ptr);
+    blk_latency_record(LATENCY_FREE, size, start);
+    BLK_PROBE1(free__return, ptr);
+}
+
+__attribute__((visibility("default"))) void *realloc(void *ptr, size_t size)
+{
+    BLK_PROBE2(realloc__entry, ptr, size);
+
+    uint64_t start = blk_latency_start();
+    void *new_ptr = blk_realloc_entry(ptr, size);
+    if (start)
+    {
+        blk_latency_record(LATENCY_REALLOC, size, start);
+    }
+
+    BLK_PROBE3(realloc__return, new_ptr, ptr, size);
+    return new_ptr;
+}
+
 __attribute__((visibility("default"))) void *calloc(size_t nmemb, size_t size)
 {
-    // Check if we need to create an allocator.
-    if (!blka.meta)
+    BLK_PROBE2(calloc__entry, nmemb, size);
+
+    uint64_t start = blk_latency_start();
+    void *ptr = blk_calloc_entry(nmemb, size);
+    if (start)
     {
-        blk_init_allocator(&blka, size);
+        blk_latency_record(LATENCY_CALLOC, nmemb * size, start);
     }
 
-    // Lock the mutex.
-    pthread_mutex_lock(&blka.lock);
+    BLK_PROBE3(calloc__return, ptr, nmemb, size);
+    return ptr;
+}
 
-    // Check for an overflow.
-    unsigned int total_size;
-    if (__builtin_umul_overflow(nmemb, size, &total_size))
+static void *blk_aligned_malloc(size_t alignment, size_t size)
+{
+    if (alignment <= MIN_DATA_SIZE)
     {
-        // Unlock the mutex.
-        pthread_mutex_unlock(&blka.lock);
+        return malloc(size);
+    }
 
-        // If it overflows, return null.
+    // Slab objects of a multiple of the alignment are aligned, their slab
+    // starts on a page. So are the sampled blocks, placed right before one.
+    size_t rounded;
+    if (__builtin_add_overflow(size ? size : 1, alignment - 1, &rounded))
+    {
         return NULL;
     }
 
-    void *ptr = blk_calloc(&blka, nmemb * size);
+    rounded &= ~(alignment - 1);
+    pthread_once(&arenas_once, blk_init_arenas);
+    if (blk_slab_enabled() && alignment <= PERCPU_MAX_SIZE
+        && rounded <= PERCPU_MAX_SIZE)
+    {
+        return malloc(rounded);
+    }
+
+    blk_allocator *blka = blk_arena_get();
+
+    // Lock the arena.
+    blk_lock_acquire(&blka->lock);
 
-    // Unlock the mutex.
-    pthread_mutex_unlock(&blka.lock);
+    // Call blk_memalign.
+    void *ptr = blk_memalign(blka, alignment, size);
+
+    // Unlock the arena.
+    blk_lock_release(&blka->lock);
 
     return ptr;
 }
+
+__attribute__((visibility("default"))) void *aligned_alloc(size_t alignment,
+                                                           size_t size)
+{
+    // Only powers of two are valid alignments.
+    if (!alignment || alignment & (alignment - 1))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return blk_aligned_malloc(alignment, size);
+}
+
+__attribute__((visibility("default"))) int posix_memalign(void **memptr,
+                                                          size_t alignment,
+                                                          size_t size)
+{
+    // The alignment must also be a multiple of the size of a pointer.
+    if (!alignment || alignment % sizeof(void *) || alignment & (alignment - 1))
+    {
+        return EINVAL;
+    }
+
+    void *ptr = blk_aligned_malloc(alignment, size);
+    if (!ptr)
+    {
+        return ENOMEM;
+    }
+
+    *memptr = ptr;
+    return 0;
+}
+
+__attribute__((visibility("default"))) void *memalign(size_t alignment,
+                                                      size_t size)
+{
+    // Other alignments are rounded up to a power of two, as glibc does.
+    if (alignment > SIZE_MAX / 2 + 1)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t power = 1;
+    while (power < alignment)
+    {
+        power <<= 1;
+    }
+
+    return blk_aligned_malloc(power, size);
+}
+
+__attribute__((visibility("default"))) void *valloc(size_t size)
+{
+    return blk_aligned_malloc(PAGE_SIZE, size);
+}
+
+__attribute__((visibility("default"))) void *pvalloc(size_t size)
+{
+    // The size is rounded up to whole pages.
+    size_t page_size = PAGE_SIZE;
+    size_t rounded;
+    if (__builtin_add_overflow(size ? size : 1, page_size - 1, &rounded))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return blk_aligned_malloc(page_size, rounded & ~(page_size - 1));
+}
+
+__attribute__((visibility("default"))) size_t malloc_batch(size_t size,
+                                                           size_t n,
+                                                           void **out)
+{
+    blk_allocator *blka = blk_arena_get();
+
+    // Lock the arena.
+    blk_lock_acquire(&blka->lock);
+
+    // Call blk_malloc_batch.
+    size_t count = blk_malloc_batch(blka, size, n, out);
+
+    // Unlock the arena.
+    blk_lock_release(&blka->lock);
+
+    return count;
+}
+
+__attribute__((visibility("default"))) void free_batch(void **ptrs, size_t n)
+{
+    blk_arena_free(ptrs, n);
+}
+
+__attribute__((visibility("default"))) size_t blk_usable_size(void *ptr)
+{
+    if (!ptr)
+    {
+        return 0;
+    }
+
+    blk_slab *slab = blk_slab_of(ptr);
+    if (slab)
+    {
+        return blk_slab_size(slab);
+    }
+
+    blk_cache_slab *cache_slab = blk_cache_slab_of(ptr);
+    if (cache_slab)
+    {
+        return cache_slab->cache->stride;
+    }
+
+    if (!blk_owner_of(ptr))
+    {
+        return blk_guard_owns(ptr) ? blk_guard_size(ptr) : 0;
+    }
+
+    // The block may be larger than requested when it was not worth a split.
+    uint8_t *ptr_p = ptr;
+    ptr_p -= sizeof(blk_meta);
+    void *temp = ptr_p;
+    blk_meta *blk = temp;
+    return blk->size;
+}
+
+__attribute__((visibility("default"))) size_t malloc_usable_size(void *ptr)
+{
+    return blk_usable_size(ptr);
+}
+
+static void blk_warm_caches(void)
+{
+    // Fill each class of this CPU as a refill would.
+    for (int cls = 0; cls < PERCPU_CLASSES; ++cls)
+    {
+        void *ptr = blk_percpu_refill(cls);
+        if (ptr && !blk_percpu_push(cls, ptr))
+        {
+            free(ptr);
+        }
+    }
+}
+
+__attribute__((visibility("default"))) int blk_heap_reserve(size_t bytes,
+                                                            int flags)
+{
+    blk_allocator *blka = blk_arena_get();
+    bool reserved = true;
+    if (bytes)
+    {
+        // Lock the arena.
+        blk_lock_acquire(&blka->lock);
+
+        // Call blk_reserve.
+        reserved = blk_reserve(blka, bytes, flags & BLK_RESERVE_POPULATE);
+
+        // Unlock the arena.
+        blk_lock_release(&blka->lock);
+    }
+
+    // The caches are filled from the reserved span when it is large enough.
+    if (flags & BLK_RESERVE_CACHES && blk_percpu_enabled())
+    {
+        blk_numa_for_each_cpu(blk_warm_caches);
+    }
+
+    return reserved ? 0 : -1;
+}
+
+__attribute__((constructor)) static void blk_reserve_at_load(void)
+{
+    // Nothing is mapped ahead of time by default.
+    const blk_config *config = blk_config_get();
+    int flags = (config->populate ? BLK_RESERVE_POPULATE : 0)
+        | (config->warm_caches ? BLK_RESERVE_CACHES : 0);
+    if (config->reserve || flags & BLK_RESERVE_CACHES)
+    {
+        blk_heap_reserve(config->reserve, flags);
+    }
+}
+
+__attribute__((visibility("default"))) int malloc_trim(size_t pad)
+{
+    // Arenas that were never created are skipped.
+    bool released = false;
+    for (int i = 0; i < arena_count; ++i)
+    {
+        // Lock the arena.
+        blk_lock_acquire(&arenas[i].lock);
+
+        // Call blk_trim.
+        released |= blk_trim(&arenas[i], pad);
+
+        // Unlock the arena.
+        blk_lock_release(&arenas[i].lock);
+    }
+
+    return released;
+}
+
+static void *blk_trim_routine(void *arg)
+{
+    struct timespec *interval = arg;
+    while (true)
+    {
+        nanosleep(interval, NULL);
+        malloc_trim(0);
+    }
+
+    return NULL;
+}
+
+__attribute__((constructor)) static void blk_start_trim_thread(void)
+{
+    // The background trimming is opt-in.
+    size_t ms = blk_config_get()->trim_interval;
+    if (!ms)
+    {
+        return;
+    }
+
+    static struct timespec interval;
+    interval.tv_sec = ms / 1000;
+    interval.tv_nsec = (ms % 1000) * 1000000;
+
+    blk_start_thread(blk_trim_routine, &interval);
+}
+
+__attribute__((visibility("default"))) void malloc_stats(void)
+{
+    for (int i = 0; i < arena_count; ++i)
+    {
+        // Copy the metrics so nothing is printed with the lock held.
+        blk_lock_acquire(&arenas[i].lock);
+        blk_lock lock = arenas[i].lock;
+        blk_lock_release(&arenas[i].lock);
+
+        fprintf(stderr, "Arena %d (node %d):\n", i, arenas[i].node);
+        fprintf(stderr, "lock acquisitions    = %20lu\n", lock.acquisitions);
+        fprintf(stderr, "lock contended       = %20lu\n", lock.contended);
+        fprintf(stderr, "lock wait (ns)       = %20lu\n", lock.wait_ns);
+    }
+}
+
+__attribute__((visibility("default"))) int
+blk_heap_iterate(blk_iterate_callback callback, void *arg)
+{
+    pthread_once(&arenas_once, blk_init_arenas);
+
+    // Each arena is only held while one of its spans or slabs is recorded.
+    for (int i = 0; i < arena_count; ++i)
+    {
+        if (!blk_iterate(&arenas[i], callback, arg))
+        {
+            return -1;
+        }
+    }
+
+    return blk_cache_iterate(callback, arg) ? 0 : -1;
+}
+
+__attribute__((visibility("default"))) int malloc_info(int options,
+                                                       FILE *stream)
+{
+    // No option is defined yet, as with glibc.
+    if (options)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_once(&arenas_once, blk_init_arenas);
+
+    // Every arena is walked before anything is written, the stream may
+    // allocate.
+    struct blk_iterate_info infos[MAX_ARENAS];
+    size_t mapped[MAX_ARENAS];
+    memset(infos, 0, sizeof(infos));
+    for (int i = 0; i < arena_count; ++i)
+    {
+        if (!blk_iterate(&arenas[i], blk_iterate_count, &infos[i]))
+        {
+            return -1;
+        }
+
+        blk_lock_acquire(&arenas[i].lock);
+        mapped[i] = arenas[i].size;
+        blk_lock_release(&arenas[i].lock);
+    }
+
+    // The object caches belong to no arena, they only count in the total.
+    struct blk_iterate_info total;
+    memset(&total, 0, sizeof(total));
+    if (!blk_cache_iterate(blk_iterate_count, &total))
+    {
+        return -1;
+    }
+
+    size_t total_mapped = 0;
+    fprintf(stream, "<malloc version=\"1\">\n");
+    for (int i = 0; i < arena_count; ++i)
+    {
+        fprintf(stream, "<heap nr=\"%d\">\n", i);
+        blk_iterate_print(stream, &infos[i], mapped[i], true);
+        fprintf(stream, "</heap>\n");
+
+        total.free_count += infos[i].free_count;
+        total.free_size += infos[i].free_size;
+        total.used_count += infos[i].used_count;
+        total.used_size += infos[i].used_size;
+        total_mapped += mapped[i];
+    }
+
+    blk_iterate_print(stream, &total, total_mapped, false);
+    fprintf(stream, "</malloc>\n");
+    return 0;
+}
+
+__attribute__((visibility("default"))) int malloc_snapshot(int fd)
+{
+    // Each arena is only held while its own snapshot is written.
+    for (int i = 0; i < arena_count; ++i)
+    {
+        // Lock the arena.
+        blk_lock_acquire(&arenas[i].lock);
+
+        // Call blk_snapshot_write.
+        bool written = blk_snapshot_write(&arenas[i], fd);
+
+        // Unlock the arena.
+        blk_lock_release(&arenas[i].lock);
+
+        if (!written)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "guard.h"
+#include "percpu.h"
+
+// The operators are defined under their Itanium C++ ABI names, where size_t
+// is mangled as unsigned long.
+#ifndef __LP64__
+#    error "operator new and delete are only provided for LP64 targets"
+#endif
+
+/// @brief Macro that define the attributes exporting a function under the
+/// name of an operator.
+#define OPERATOR(name) __asm__(name) __attribute__((visibility("default")))
+
+typedef void (*blk_new_handler)(void);
+
+// From libstdc++, always loaded by the programs calling the operators. They
+// are weak so C programs do not need it.
+__attribute__((weak)) blk_new_handler blk_get_new_handler(void) __asm__(
+    "_ZSt15get_new_handlerv");
+__attribute__((weak, noreturn)) void blk_throw_bad_alloc(void) __asm__(
+    "_ZSt17__throw_bad_allocv");
+
+static void *blk_new(size_t size, size_t alignment, bool nothrow)
+{
+    while (true)
+    {
+        void *ptr = alignment ? memalign(alignment, size) : malloc(size);
+        if (ptr || nothrow)
+        {
+            return ptr;
+        }
+
+        // The new handler may release memory, it is called until it gives up.
+        blk_new_handler handler =
+            blk_get_new_handler ? blk_get_new_handler() : NULL;
+        if (!handler && blk_throw_bad_alloc)
+        {
+            blk_throw_bad_alloc();
+        }
+        else if (!handler)
+        {
+            abort();
+        }
+
+        handler();
+    }
+}
+
+static void blk_delete_sized(void *ptr, size_t size)
+{
+    // The size gives the class of the cache without reading the header of
+    // the block or the page map. Sampled blocks go back to their pool.
+    int cls = blk_percpu_class_of(size);
+    if (ptr && cls >= 0 && !blk_guard_owns(ptr) && blk_percpu_push(cls, ptr))
+    {
+        return;
+    }
+
+    free(ptr);
+}
+
+// operator new and new[].
+void *blk_operator_new(size_t size) OPERATOR("_Znwm");
+void *blk_operator_new_array(size_t size) OPERATOR("_Znam");
+void *blk_operator_new_nothrow(size_t size, const void *tag)
+    OPERATOR("_ZnwmRKSt9nothrow_t");
+void *blk_operator_new_array_nothrow(size_t size, const void *tag)
+    OPERATOR("_ZnamRKSt9nothrow_t");
+void *blk_operator_new_aligned(size_t size, size_t alignment)
+    OPERATOR("_ZnwmSt11align_val_t");
+void *blk_operator_new_array_aligned(size_t size, size_t alignment)
+    OPERATOR("_ZnamSt11align_val_t");
+void *blk_operator_new_aligned_nothrow(size_t size, size_t alignment,
+                                       const void *tag)
+    OPERATOR("_ZnwmSt11align_val_tRKSt9nothrow_t");
+void *blk_operator_new_array_aligned_nothrow(size_t size, size_t alignment,
+                                             const void *tag)
+    OPERATOR("_ZnamSt11align_val_tRKSt9nothrow_t");
+
+void *blk_operator_new(size_t size)
+{
+    return blk_new(size, 0, false);
+}
+
+void *blk_operator_new_array(size_t size)
+{
+    return blk_new(size, 0, false);
+}
+
+void *blk_operator_new_nothrow(size_t size, const void *tag)
+{
+    (void)tag;
+    return blk_new(size, 0, true);
+}
+
+void *blk_operator_new_array_nothrow(size_t size, const void *tag)
+{
+    (void)tag;
+    return blk_new(size, 0, true);
+}
+
+void *blk_operator_new_aligned(size_t size, size_t alignment)
+{
+    return blk_new(size, alignment, false);
+}
+
+void *blk_operator_new_array_aligned(size_t size, size_t alignment)
+{
+    return blk_new(size, alignment, false);
+}
+
+void *blk_operator_new_aligned_nothrow(size_t size, size_t alignment,
+                                       const void *tag)
+{
+    (void)tag;
+    return blk_new(size, alignment, true);
+}
+
+void *blk_operator_new_array_aligned_nothrow(size_t size, size_t alignment,
+                                             const void *tag)
+{
+    (void)tag;
+    return blk_new(size, alignment, true);
+}
+
+// operator delete and delete[].
+void blk_operator_delete(void *ptr) OPERATOR("_ZdlPv");
+void blk_operator_delete_array(void *ptr) OPERATOR("_ZdaPv");
+void blk_operator_delete_nothrow(void *ptr, const void *tag)
+    OPERATOR("_ZdlPvRKSt9nothrow_t");
+void blk_operator_delete_array_nothrow(void *ptr, const void *tag)
+    OPERATOR("_ZdaPvRKSt9nothrow_t");
+void blk_operator_delete_sized(void *ptr, size_t size) OPERATOR("_ZdlPvm");
+void blk_operator_delete_array_sized(void *ptr, size_t size)
+    OPERATOR("_ZdaPvm");
+void blk_operator_delete_aligned(void *ptr, size_t alignment)
+    OPERATOR("_ZdlPvSt11align_val_t");
+void blk_operator_delete_array_aligned(void *ptr, size_t alignment)
+    OPERATOR("_ZdaPvSt11align_val_t");
+void blk_operator_delete_aligned_nothrow(void *ptr, size_t alignment,
+                                         const void *tag)
+    OPERATOR("_ZdlPvSt11align_val_tRKSt9nothrow_t");
+void blk_operator_delete_array_aligned_nothrow(void *ptr, size_t alignment,
+                                               const void *tag)
+    OPERATOR("_ZdaPvSt11align_val_tRKSt9nothrow_t");
+void blk_operator_delete_sized_aligned(void *ptr, size_t size,
+                                       size_t alignment)
+    OPERATOR("_ZdlPvmSt11align_val_t");
+void blk_operator_delete_array_sized_aligned(void *ptr, size_t size,
+                                             size_t alignment)
+    OPERATOR("_ZdaPvmSt11align_val_t");
+
+void blk_operator_delete(void *ptr)
+{
+    free(ptr);
+}
+
+void blk_operator_delete_array(void *ptr)
+{
+    free(ptr);
+}
+
+void blk_operator_delete_nothrow(void *ptr, const void *tag)
+{
+    (void)tag;
+    free(ptr);
+}
+
+void blk_operator_delete_array_nothrow(void *ptr, const void *tag)
+{
+    (void)tag;
+    free(ptr);
+}
+
+void blk_operator_delete_sized(void *ptr, size_t size)
+{
+    blk_delete_sized(ptr, size);
+}
+
+void blk_operator_delete_array_sized(void *ptr, size_t size)
+{
+    blk_delete_sized(ptr, size);
+}
+
+// Aligned blocks may come from a larger class than their size, the class is
+// read from the block.
+void blk_operator_delete_aligned(void *ptr, size_t alignment)
+{
+    (void)alignment;
+    free(ptr);
+}
+
+void blk_operator_delete_array_aligned(void *ptr, size_t alignment)
+{
+    (void)alignment;
+    free(ptr);
+}
+
+void blk_operator_delete_aligned_nothrow(void *ptr, size_t alignment,
+                                         const void *tag)
+{
+    (void)alignment;
+    (void)tag;
+    free(ptr);
+}
+
+void blk_operator_delete_array_aligned_nothrow(void *ptr, size_t alignment,
+                                               const void *tag)
+{
+    (void)alignment;
+    (void)tag;
+    free(ptr);
+}
+
+void blk_operator_delete_sized_aligned(void *ptr, size_t size, size_t alignment)
+{
+    (void)size;
+    (void)alignment;
+    free(ptr);
+}
+
+void blk_operator_delete_array_sized_aligned(void *ptr, size_t size,
+                                             size_t alignment)
+{
+    (void)size;
+    (void)alignment;
+    free(ptr);
+}
@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+
+#include "numa.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// @brief Macro that define the mbind() preferred mode (see numaif.h).
+#define MPOL_PREFERRED 1
+
+/// @brief Macro that define the sysfs file listing the possible nodes.
+#define NODE_POSSIBLE_PATH "/sys/devices/system/node/possible"
+
+/// @brief Macro that define the sysfs file listing the possible CPUs.
+#define CPU_POSSIBLE_PATH "/sys/devices/system/cpu/possible"
+
+static int blk_numa_read_count(const char *path)
+{
+    // The file holds a range such as "0" or "0-3", no malloc involved.
+    char buffer[64];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return 1;
+    }
+
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return 1;
+    }
+
+    buffer[length] = '\0';
+
+    // Keep the last number of the list, it is the highest one.
+    int last = 0;
+    int current = 0;
+    for (ssize_t i = 0; i <= length; ++i)
+    {
+        if (buffer[i] >= '0' && buffer[i] <= '9')
+        {
+            current = current * 10 + buffer[i] - '0';
+        }
+        else
+        {
+            if (i > 0 && buffer[i - 1] >= '0' && buffer[i - 1] <= '9')
+            {
+                last = current;
+            }
+
+            current = 0;
+        }
+    }
+
+    return last + 1;
+}
+
+int blk_numa_node_count(void)
+{
+    int count = blk_numa_read_count(NODE_POSSIBLE_PATH);
+    if (count > NUMA_MAX_NODES)
+    {
+        return NUMA_MAX_NODES;
+    }
+
+    return count;
+}
+
+int blk_numa_cpu_count(void)
+{
+    return blk_numa_read_count(CPU_POSSIBLE_PATH);
+}
+
+int blk_numa_current_node(void)
+{
+    unsigned int cpu;
+    unsigned int node;
+    if (getcpu(&cpu, &node) == -1)
+    {
+        return 0;
+    }
+
+    return node;
+}
+
+int blk_numa_current_cpu(void)
+{
+    unsigned int cpu;
+    if (getcpu(&cpu, NULL) == -1)
+    {
+        return 0;
+    }
+
+    return cpu;
+}
+
+void blk_numa_for_each_cpu(void (*fn)(void))
+{
+    // Fixed size sets, CPU_ALLOC() would call malloc.
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    {
+        fn();
+        return;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+        {
+            continue;
+        }
+
+        // The thread is migrated before the call returns.
+        cpu_set_t single;
+        CPU_ZERO(&single);
+        CPU_SET(cpu, &single);
+        if (!sched_setaffinity(0, sizeof(single), &single))
+        {
+            fn();
+        }
+    }
+
+    sched_setaffinity(0, sizeof(allowed), &allowed);
+}
+
+void blk_numa_bind(void *addr, size_t size, int node)
+{
+    // A failure only costs locality, the memory stays usable.
+    unsigned long mask = 1UL << node;
+    unsigned long max_node = sizeof(mask) * 8 + 1;
+    syscall(SYS_mbind, addr, size, MPOL_PREFERRED, &mask, max_node, 0);
+}
@@ -0,0 +1,36 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+
+/// @brief Macro that define the highest number of NUMA nodes handled.
+#define NUMA_MAX_NODES 64
+
+/// @brief Get the number of NUMA nodes of the machine.
+/// @return The number of possible nodes, at least 1.
+int blk_numa_node_count(void);
+
+/// @brief Get the number of CPUs of the machine without calling malloc.
+/// @return The number of possible CPUs, at least 1.
+int blk_numa_cpu_count(void);
+
+/// @brief Get the NUMA node of the CPU the calling thread runs on.
+/// @return The node, 0 if it cannot be determined.
+int blk_numa_current_node(void);
+
+/// @brief Get the CPU the calling thread runs on.
+/// @return The CPU, 0 if it cannot be determined.
+int blk_numa_current_cpu(void);
+
+/// @brief Call a function on every CPU the calling thread may run on, moving
+/// the thread to each of them in turn. Its affinity is restored afterwards.
+/// @param fn The function.
+void blk_numa_for_each_cpu(void (*fn)(void));
+
+/// @brief Ask the kernel to place the pages of a region on a node.
+/// @param addr The start of the region, aligned on a page.
+/// @param size The size of the region.
+/// @param node The preferred node.
+void blk_numa_bind(void *addr, size_t size, int node);
+
+#endif /* ! NUMA_H */
@@ -0,0 +1,222 @@
+#include "pagemap.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+/// @brief Macro that define the highest page number of the map.
+#define PAGEMAP_MAX_PAGE ((uintptr_t)1 << (3 * PAGEMAP_LEVEL_BITS))
+
+/// @brief Macro to get the index of a page number in a level, 0 being the
+/// root.
+#define PAGEMAP_INDEX(page, level)                                             \
+    (((page) >> ((2 - (level)) * PAGEMAP_LEVEL_BITS)) & (PAGEMAP_ENTRIES - 1))
+
+/// @brief Macro that define the tag of the entries pointing to a slab, spans
+/// are aligned on a page so their low bit is free.
+#define PAGEMAP_SLAB_TAG ((uintptr_t)1)
+
+/// @brief Macro that define the tag of the entries pointing to a slab of an
+/// object cache, aligned on a page too.
+#define PAGEMAP_CACHE_TAG ((uintptr_t)2)
+
+/// @brief Macro that define the bits of the tags.
+#define PAGEMAP_TAGS (PAGEMAP_SLAB_TAG | PAGEMAP_CACHE_TAG)
+
+struct blk_pagemap_leaf
+{
+    // Span or tagged slab of each page
+    uintptr_t entries[PAGEMAP_ENTRIES];
+};
+
+struct blk_pagemap_node
+{
+    // Leaves, as installed by blk_pagemap_level()
+    void *leaves[PAGEMAP_ENTRIES];
+};
+
+// Root of the map, the lower levels are mapped on first use and never freed.
+static void *root[PAGEMAP_ENTRIES];
+
+static void *blk_pagemap_level(void **slot, size_t size, bool create)
+{
+    void *level = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (level || !create)
+    {
+        return level;
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // Another arena may have installed it first.
+    if (!__atomic_compare_exchange_n(slot, &level, addr, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        munmap(addr, size);
+        return level;
+    }
+
+    return addr;
+}
+
+static bool blk_pagemap_store(void *addr, size_t size, uintptr_t entry)
+{
+    uintptr_t first = (uintptr_t)addr >> PAGEMAP_PAGE_SHIFT;
+    uintptr_t last = ((uintptr_t)addr + size - 1) >> PAGEMAP_PAGE_SHIFT;
+    if (last >= PAGEMAP_MAX_PAGE)
+    {
+        return false;
+    }
+
+    // Levels are only created to add pages, a missing one has none to remove.
+    bool create = entry;
+    for (uintptr_t page = first; page <= last; ++page)
+    {
+        struct blk_pagemap_node *node =
+            blk_pagemap_level(&root[PAGEMAP_INDEX(page, 0)],
+                              sizeof(struct blk_pagemap_node), create);
+        if (!node && create)
+        {
+            return false;
+        }
+        else if (!node)
+        {
+            continue;
+        }
+
+        struct blk_pagemap_leaf *leaf =
+            blk_pagemap_level(&node->leaves[PAGEMAP_INDEX(page, 1)],
+                              sizeof(struct blk_pagemap_leaf), create);
+        if (!leaf && create)
+        {
+            return false;
+        }
+        else if (!leaf)
+        {
+            continue;
+        }
+
+        __atomic_store_n(&leaf->entries[PAGEMAP_INDEX(page, 2)], entry,
+                         __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+static uintptr_t blk_pagemap_load(const void *ptr)
+{
+    uintptr_t page = (uintptr_t)ptr >> PAGEMAP_PAGE_SHIFT;
+    if (page >= PAGEMAP_MAX_PAGE)
+    {
+        return 0;
+    }
+
+    struct blk_pagemap_node *node =
+        __atomic_load_n(&root[PAGEMAP_INDEX(page, 0)], __ATOMIC_ACQUIRE);
+    if (!node)
+    {
+        return 0;
+    }
+
+    void **leaf_slot = &node->leaves[PAGEMAP_INDEX(page, 1)];
+    struct blk_pagemap_leaf *leaf = __atomic_load_n(leaf_slot, __ATOMIC_ACQUIRE);
+    if (!leaf)
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(&leaf->entries[PAGEMAP_INDEX(page, 2)],
+                           __ATOMIC_ACQUIRE);
+}
+
+bool blk_pagemap_set(void *addr, size_t size, struct blk_span *span)
+{
+    return blk_pagemap_store(addr, size, (uintptr_t)span);
+}
+
+bool blk_pagemap_set_slab(void *addr, size_t size, struct blk_slab *slab)
+{
+    return blk_pagemap_store(addr, size,
+                             slab ? (uintptr_t)slab | PAGEMAP_SLAB_TAG : 0);
+}
+
+bool blk_pagemap_set_cache(void *addr, size_t size,
+                           struct blk_cache_slab *slab)
+{
+    return blk_pagemap_store(addr, size,
+                             slab ? (uintptr_t)slab | PAGEMAP_CACHE_TAG : 0);
+}
+
+struct blk_span *blk_pagemap_get(const void *ptr)
+{
+    uintptr_t entry = blk_pagemap_load(ptr);
+    if (entry & PAGEMAP_TAGS)
+    {
+        return NULL;
+    }
+
+    return (struct blk_span *)entry;
+}
+
+struct blk_slab *blk_pagemap_get_slab(const void *ptr)
+{
+    uintptr_t entry = blk_pagemap_load(ptr);
+    if ((entry & PAGEMAP_TAGS) != PAGEMAP_SLAB_TAG)
+    {
+        return NULL;
+    }
+
+    return (struct blk_slab *)(entry & ~PAGEMAP_SLAB_TAG);
+}
+
+struct blk_cache_slab *blk_pagemap_get_cache(const void *ptr)
+{
+    uintptr_t entry = blk_pagemap_load(ptr);
+    if ((entry & PAGEMAP_TAGS) != PAGEMAP_CACHE_TAG)
+    {
+        return NULL;
+    }
+
+    return (struct blk_cache_slab *)(entry & ~PAGEMAP_CACHE_TAG);
+}
+
+struct blk_slab *blk_pagemap_next_slab(uintptr_t *addr)
+{
+    uintptr_t page = *addr >> PAGEMAP_PAGE_SHIFT;
+    while (page < PAGEMAP_MAX_PAGE)
+    {
+        struct blk_pagemap_node *node =
+            __atomic_load_n(&root[PAGEMAP_INDEX(page, 0)], __ATOMIC_ACQUIRE);
+        if (!node)
+        {
+            page = (page | ((uintptr_t)PAGEMAP_ENTRIES * PAGEMAP_ENTRIES - 1))
+                + 1;
+            continue;
+        }
+
+        void **leaf_slot = &node->leaves[PAGEMAP_INDEX(page, 1)];
+        struct blk_pagemap_leaf *leaf =
+            __atomic_load_n(leaf_slot, __ATOMIC_ACQUIRE);
+        if (!leaf)
+        {
+            page = (page | (PAGEMAP_ENTRIES - 1)) + 1;
+            continue;
+        }
+
+        uintptr_t entry = __atomic_load_n(
+            &leaf->entries[PAGEMAP_INDEX(page, 2)], __ATOMIC_ACQUIRE);
+        if ((entry & PAGEMAP_TAGS) == PAGEMAP_SLAB_TAG)
+        {
+            *addr = page << PAGEMAP_PAGE_SHIFT;
+            return (struct blk_slab *)(entry & ~PAGEMAP_SLAB_TAG);
+        }
+
+        ++page;
+    }
+
+    return NULL;
+}
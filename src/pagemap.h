@@ -0,0 +1,69 @@
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Macro that define the shift of the pages indexed by the map. Spans
+/// are made of system pages, which are multiples of these.
+#define PAGEMAP_PAGE_SHIFT 12
+
+/// @brief Macro that define the number of bits of a page number resolved by
+/// each of the 3 levels, covering 48 bits of address space.
+#define PAGEMAP_LEVEL_BITS 12
+
+/// @brief Macro that define the number of entries of a level.
+#define PAGEMAP_ENTRIES (1 << PAGEMAP_LEVEL_BITS)
+
+struct blk_span;
+struct blk_slab;
+struct blk_cache_slab;
+
+/// @brief Map every page of a region to a span, or unmap them.
+/// @param addr The start of the region, aligned on a page.
+/// @param size The size of the region.
+/// @param span The span owning the region, NULL to remove it from the map.
+/// @return false if the region cannot be indexed, true otherwise.
+bool blk_pagemap_set(void *addr, size_t size, struct blk_span *span);
+
+/// @brief Map every page of a region to a slab, or unmap them.
+/// @param addr The start of the region, aligned on a page.
+/// @param size The size of the region.
+/// @param slab The descriptor of the slab, NULL to remove it from the map.
+/// @return false if the region cannot be indexed, true otherwise.
+bool blk_pagemap_set_slab(void *addr, size_t size, struct blk_slab *slab);
+
+/// @brief Map every page of a region to a slab of an object cache, or unmap
+/// them.
+/// @param addr The start of the region, aligned on a page.
+/// @param size The size of the region.
+/// @param slab The slab, NULL to remove it from the map.
+/// @return false if the region cannot be indexed, true otherwise.
+bool blk_pagemap_set_cache(void *addr, size_t size,
+                           struct blk_cache_slab *slab);
+
+/// @brief Find the span owning an address, without taking any lock.
+/// @param ptr The address.
+/// @return The span, NULL if the address was not mapped by the allocator or
+/// belongs to a slab.
+struct blk_span *blk_pagemap_get(const void *ptr);
+
+/// @brief Find the slab holding an address, without taking any lock.
+/// @param ptr The address.
+/// @return The descriptor of the slab, NULL if the address is not in a slab.
+struct blk_slab *blk_pagemap_get_slab(const void *ptr);
+
+/// @brief Find the slab of an object cache holding an address, without
+/// taking any lock.
+/// @param ptr The address.
+/// @return The slab, NULL if the address is not in an object cache.
+struct blk_cache_slab *blk_pagemap_get_cache(const void *ptr);
+
+/// @brief Find the first page mapped to a slab from an address on, without
+/// taking any lock. The levels that are not mapped are skipped whole.
+/// @param addr The address to start from, receives the address of the page.
+/// @return The descriptor of the slab, NULL if no slab is mapped above.
+struct blk_slab *blk_pagemap_next_slab(uintptr_t *addr);
+
+#endif /* ! PAGEMAP_H */
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+
+#include "percpu.h"
+
+#include <sched.h>
+#include <time.h>
+
+#include "config.h"
+#include "numa.h"
+
+struct blk_percpu_state blk_percpu_state;
+
+bool blk_percpu_find(int cls, const void *ptr)
+{
+    // A cache may change meanwhile, a block freed twice is no longer freed
+    // by the same thread by then.
+    for (uint32_t cpu = 0; cpu < blk_percpu_state.cpus; ++cpu)
+    {
+        struct blk_percpu_class *cache =
+            &blk_percpu_state.caches[cpu].classes[cls];
+        uint32_t count = __atomic_load_n(&cache->count, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < count && i < PERCPU_SLOTS; ++i)
+        {
+            if (__atomic_load_n(&cache->slots[i], __ATOMIC_RELAXED) == ptr)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+#ifdef HAVE_RSEQ
+
+void blk_percpu_init(void)
+{
+    // glibc registers every thread, a size of 0 means it could not.
+    if (!__rseq_size || (int32_t)blk_rseq_cpu(blk_rseq_area()) < 0)
+    {
+        return;
+    }
+
+    uint32_t slots = blk_config_get()->percpu_slots;
+    if (!slots)
+    {
+        return;
+    }
+
+    uint32_t cpus = blk_numa_cpu_count();
+    void *addr = mmap(NULL, cpus * sizeof(struct blk_percpu), PROT_FLAGS,
+                      MAP_FLAGS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        return;
+    }
+
+    // Unlikely to be the first word of a block in use.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    blk_percpu_state.key =
+        ((uintptr_t)addr ^ (uintptr_t)now.tv_nsec) * 0x9e3779b97f4a7c15ULL | 1;
+
+    blk_percpu_state.cpus = cpus;
+    blk_percpu_state.slots = slots;
+    blk_percpu_state.caches = addr;
+}
+
+static bool blk_percpu_is_empty(uint32_t cpu)
+{
+    for (int cls = 0; cls < PERCPU_CLASSES; ++cls)
+    {
+        struct blk_percpu_class *cache =
+            &blk_percpu_state.caches[cpu].classes[cls];
+        if (__atomic_load_n(&cache->count, __ATOMIC_RELAXED))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void blk_percpu_drain_current(void (*release)(void **, size_t))
+{
+    // Pop from whichever CPU the thread runs on, as malloc() does.
+    void *ptrs[PERCPU_SLOTS];
+    for (int cls = 0; cls < PERCPU_CLASSES; ++cls)
+    {
+        size_t count = PERCPU_SLOTS;
+        while (count == PERCPU_SLOTS)
+        {
+            count = 0;
+            while (count < PERCPU_SLOTS && (ptrs[count] = blk_percpu_pop(cls)))
+            {
+                ++count;
+            }
+
+            release(ptrs, count);
+        }
+    }
+}
+
+void blk_percpu_drain(void (*release)(void **ptrs, size_t count))
+{
+    if (!blk_percpu_state.caches)
+    {
+        return;
+    }
+
+    cpu_set_t old;
+    if (sched_getaffinity(0, sizeof(old), &old))
+    {
+        blk_percpu_drain_current(release);
+        return;
+    }
+
+    // Only the thread running on a CPU may touch its cache, so move to each
+    // CPU holding blocks in turn. Those the thread may not run on are left.
+    for (uint32_t cpu = 0; cpu < blk_percpu_state.cpus && cpu < CPU_SETSIZE;
+         ++cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (!blk_percpu_is_empty(cpu)
+            && !sched_setaffinity(0, sizeof(set), &set))
+        {
+            blk_percpu_drain_current(release);
+        }
+    }
+
+    sched_setaffinity(0, sizeof(old), &old);
+}
+
+#else /* ! HAVE_RSEQ */
+
+void blk_percpu_init(void)
+{
+}
+
+void blk_percpu_drain(void (*release)(void **ptrs, size_t count))
+{
+    (void)release;
+}
+
+#endif /* HAVE_RSEQ */
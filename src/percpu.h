@@ -0,0 +1,299 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include "allocator.h"
+
+#if defined(__x86_64__) && defined(__has_include)
+#    if __has_include(<sys/rseq.h>)
+#        include <sys/rseq.h>
+#        define HAVE_RSEQ 1
+#    endif
+#endif
+
+/// @brief Macro that define the number of size classes cached per CPU.
+#define PERCPU_CLASSES 16
+
+/// @brief Macro that define the largest request served by the caches.
+#define PERCPU_MAX_SIZE (PERCPU_CLASSES * MIN_DATA_SIZE)
+
+/// @brief Macro that define how many blocks a CPU keeps per size class.
+#define PERCPU_SLOTS 32
+
+struct blk_percpu_class
+{
+    // Number of blocks in slots
+    uint32_t count;
+    void *slots[PERCPU_SLOTS];
+};
+
+struct blk_percpu
+{
+    struct blk_percpu_class classes[PERCPU_CLASSES];
+};
+
+struct blk_percpu_state
+{
+    // Caches of every CPU, NULL while disabled
+    struct blk_percpu *caches;
+    uint32_t cpus;
+    uint32_t slots;
+
+    // Written in the first word of the cached blocks, a block freed while it
+    // still holds it may already be in a cache
+    uintptr_t key;
+};
+
+/// @brief State of the caches, read by the inline functions below so the
+/// fast path of malloc() and free() does not call out of line.
+extern __attribute__((visibility("hidden"))) struct blk_percpu_state
+    blk_percpu_state;
+
+/// @brief Map the caches of every CPU, each class holding up to percpu_slots
+/// blocks. They stay disabled if the kernel or the C library does not provide
+/// restartable sequences, or if percpu_slots is 0.
+void blk_percpu_init(void);
+
+/// @brief Empty the caches of every CPU the thread may run on, moving it to
+/// each of them in turn. Its affinity is restored afterwards.
+/// @param release Called with the blocks taken, a batch at a time.
+void blk_percpu_drain(void (*release)(void **ptrs, size_t count));
+
+/// @brief Look for a block in the caches of every CPU, without stopping them.
+/// @param cls The size class.
+/// @param ptr The data pointer.
+/// @return true if a cache holds it, false otherwise.
+bool blk_percpu_find(int cls, const void *ptr);
+
+/// @brief Tell if the caches are in use.
+/// @return true if blocks are cached, false otherwise.
+static inline bool blk_percpu_enabled(void)
+{
+    return blk_percpu_state.caches;
+}
+
+/// @brief Get how many blocks a CPU keeps per size class.
+/// @return The number of slots in use, 0 while disabled.
+static inline uint32_t blk_percpu_slots(void)
+{
+    return blk_percpu_state.slots;
+}
+
+/// @brief Get the size class serving a request.
+/// @param size The size requested.
+/// @return The size class, -1 if the request is too big to be cached.
+static inline int blk_percpu_class_of(size_t size)
+{
+    if (size > PERCPU_MAX_SIZE)
+    {
+        return -1;
+    }
+
+    // A request of 0 bytes still gets the smallest block.
+    size_t units = (size + MIN_DATA_SIZE - 1) / MIN_DATA_SIZE;
+    return units ? units - 1 : 0;
+}
+
+/// @brief Get the size class a block can be reused for.
+/// @param size The size of the block.
+/// @return The size class, -1 if the block should not be cached.
+static inline int blk_percpu_class_of_block(size_t size)
+{
+    // Blocks large enough to be split are left to the allocator.
+    if (size < MIN_DATA_SIZE
+        || size >= PERCPU_MAX_SIZE + sizeof(blk_meta) + MIN_DATA_SIZE)
+    {
+        return -1;
+    }
+
+    size_t units = size / MIN_DATA_SIZE;
+    return units > PERCPU_CLASSES ? PERCPU_CLASSES - 1 : units - 1;
+}
+
+/// @brief Get the size of the blocks of a size class.
+/// @param cls The size class.
+/// @return The size to request to the allocator.
+static inline size_t blk_percpu_class_size(int cls)
+{
+    return (cls + 1) * MIN_DATA_SIZE;
+}
+
+#ifdef HAVE_RSEQ
+
+/// @brief Macro that define the critical section descriptor (label 3), from
+/// label 1 to the commit at label 2, and the abort handler (label 4) preceded
+/// by the signature the kernel checks before jumping to it. Every inlined
+/// copy gets its own descriptor.
+#    define RSEQ_CRITICAL_SECTION(abort)                                       \
+        ".pushsection __rseq_cs, \"aw\"\n\t"                                   \
+        ".balign 32\n\t"                                                       \
+        "3:\n\t"                                                               \
+        ".long 0x0, 0x0\n\t"                                                   \
+        ".quad 1f, (2f - 1f), 4f\n\t"                                          \
+        ".popsection\n\t"                                                      \
+        ".pushsection __rseq_failure, \"ax\"\n\t"                              \
+        ".byte 0x0f, 0xb9, 0x3d\n\t"                                           \
+        ".long 0x53053053\n\t"                                                 \
+        "4:\n\t"                                                               \
+        "jmp %l[" abort "]\n\t"                                                \
+        ".popsection\n\t"                                                      \
+        "leaq 3b(%%rip), %%rax\n\t"                                            \
+        "movq %%rax, 8(%[rseq])\n\t"                                           \
+        "1:\n\t"                                                               \
+        "cmpl %[cpu], 4(%[rseq])\n\t"                                          \
+        "jnz 4b\n\t"
+
+static inline struct rseq *blk_rseq_area(void)
+{
+    uint8_t *thread_pointer = __builtin_thread_pointer();
+    void *temp = thread_pointer + __rseq_offset;
+    return temp;
+}
+
+static inline uint32_t blk_rseq_cpu(struct rseq *rseq)
+{
+    volatile uint32_t *cpu = &rseq->cpu_id_start;
+    return *cpu;
+}
+
+/// @brief Take a block from the cache of the current CPU.
+/// @param cls The size class.
+/// @return A data pointer, NULL if the cache is empty or disabled.
+static inline void *blk_percpu_pop(int cls)
+{
+    if (!blk_percpu_state.caches)
+    {
+        return NULL;
+    }
+
+    struct rseq *rseq = blk_rseq_area();
+    void *ptr;
+
+retry:;
+    uint32_t cpu = blk_rseq_cpu(rseq);
+    if (cpu >= blk_percpu_state.cpus)
+    {
+        return NULL;
+    }
+
+    struct blk_percpu_class *cache = &blk_percpu_state.caches[cpu].classes[cls];
+
+    // Restarted by the kernel if the thread is preempted or migrated before
+    // the count is stored, so no other thread can touch this CPU cache.
+    __asm__ goto(RSEQ_CRITICAL_SECTION("abort")
+                 "movl (%[count]), %%ecx\n\t"
+                 "testl %%ecx, %%ecx\n\t"
+                 "jz %l[empty]\n\t"
+                 "decl %%ecx\n\t"
+                 "movq (%[slots], %%rcx, 8), %%rax\n\t"
+                 "movq %%rax, (%[ptr])\n\t"
+                 "movl %%ecx, (%[count])\n\t"
+                 "2:\n\t"
+                 :
+                 : [rseq] "r"(rseq), [cpu] "r"(cpu),
+                   [count] "r"(&cache->count), [slots] "r"(cache->slots),
+                   [ptr] "r"(&ptr)
+                 : "rax", "rcx", "memory", "cc"
+                 : abort, empty);
+
+    // The block leaves the cache, so does its key.
+    uintptr_t *word = ptr;
+    *word = 0;
+    return ptr;
+
+abort:
+    goto retry;
+
+empty:
+    return NULL;
+}
+
+/// @brief Put a block in the cache of the current CPU.
+/// @param cls The size class.
+/// @param ptr The data pointer.
+/// @return true if it was cached, false if the cache is full or disabled.
+static inline bool blk_percpu_push(int cls, void *ptr)
+{
+    if (!blk_percpu_state.caches)
+    {
+        return false;
+    }
+
+    struct rseq *rseq = blk_rseq_area();
+    uintptr_t *word = ptr;
+    *word = blk_percpu_state.key;
+
+retry:;
+    uint32_t cpu = blk_rseq_cpu(rseq);
+    if (cpu >= blk_percpu_state.cpus)
+    {
+        goto full;
+    }
+
+    struct blk_percpu_class *cache = &blk_percpu_state.caches[cpu].classes[cls];
+
+    // The slot is written first, the block is only visible once the count
+    // is committed.
+    __asm__ goto(RSEQ_CRITICAL_SECTION("abort")
+                 "movl (%[count]), %%ecx\n\t"
+                 "cmpl %[size], %%ecx\n\t"
+                 "jae %l[full]\n\t"
+                 "movq %[ptr], (%[slots], %%rcx, 8)\n\t"
+                 "incl %%ecx\n\t"
+                 "movl %%ecx, (%[count])\n\t"
+                 "2:\n\t"
+                 :
+                 : [rseq] "r"(rseq), [cpu] "r"(cpu),
+                   [count] "r"(&cache->count), [slots] "r"(cache->slots),
+                   [ptr] "r"(ptr), [size] "r"(blk_percpu_state.slots)
+                 : "rax", "rcx", "memory", "cc"
+                 : abort, full);
+    return true;
+
+abort:
+    goto retry;
+
+full:
+    // Only the cached blocks hold the key.
+    *word = 0;
+    return false;
+}
+
+#else /* ! HAVE_RSEQ */
+
+static inline void *blk_percpu_pop(int cls)
+{
+    (void)cls;
+    return NULL;
+}
+
+static inline bool blk_percpu_push(int cls, void *ptr)
+{
+    (void)cls;
+    (void)ptr;
+    return false;
+}
+
+#endif /* HAVE_RSEQ */
+
+/// @brief Tell if a block holds the key, written by blk_percpu_push() and
+/// cleared when the block leaves the cache or could not enter it.
+/// @param ptr The data pointer.
+/// @return true if the block is cached, or holds the same value by chance,
+/// false otherwise.
+static inline bool blk_percpu_has_key(const void *ptr)
+{
+    const uintptr_t *word = ptr;
+    return blk_percpu_state.caches && *word == blk_percpu_state.key;
+}
+
+/// @brief Tell if a block being freed is already cached, freeing it again
+/// would hand it out twice. Only the blocks holding the key are looked for.
+/// @param cls The size class.
+/// @param ptr The data pointer.
+/// @return true if a cache holds it, false otherwise.
+static inline bool blk_percpu_is_cached(int cls, const void *ptr)
+{
+    return blk_percpu_has_key(ptr) && blk_percpu_find(cls, ptr);
+}
+
+#endif /* ! PERCPU_H */
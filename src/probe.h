@@ -0,0 +1,63 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdint.h>
+
+/// @brief Macro that define the provider of the probes, as perf and bpftrace
+/// name them (usdt:libmalloc.so:blk:malloc__entry).
+#define PROBE_PROVIDER "blk"
+
+// Statically defined tracepoints in the format of <sys/sdt.h>, which is not
+// always installed. Each probe is a nop, and a note in .note.stapsdt giving
+// its address and where its arguments are, so a tracer attached to it turns
+// the nop into a breakpoint. Arguments are passed as 64 bit unsigned values.
+#if defined(__x86_64__) || defined(__aarch64__)
+
+/// @brief Macro that define the assembly of a probe and of its note.
+#    define PROBE_ASM(name, args)                                              \
+        "990: nop\n"                                                           \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"                          \
+        ".balign 4\n"                                                          \
+        ".4byte 992f-991f, 994f-993f, 3\n"                                     \
+        "991: .asciz \"stapsdt\"\n"                                            \
+        "992: .balign 4\n"                                                     \
+        "993: .8byte 990b\n"                                                   \
+        ".8byte _.stapsdt.base\n"                                              \
+        ".8byte 0\n"                                                           \
+        ".asciz \"" PROBE_PROVIDER "\"\n"                                      \
+        ".asciz \"" #name "\"\n"                                               \
+        ".asciz \"" args "\"\n"                                                \
+        "994: .balign 4\n"                                                     \
+        ".popsection\n"                                                        \
+        ".ifndef _.stapsdt.base\n"                                             \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\","                      \
+        ".stapsdt.base,comdat\n"                                               \
+        ".weak _.stapsdt.base\n"                                               \
+        ".hidden _.stapsdt.base\n"                                             \
+        "_.stapsdt.base: .space 1\n"                                           \
+        ".size _.stapsdt.base, 1\n"                                            \
+        ".popsection\n"                                                        \
+        ".endif\n"
+
+/// @brief Macro that define an argument, left where it already is: a
+/// register, a stack slot or a constant.
+#    define PROBE_ARG(value) "nor"((uint64_t)(uintptr_t)(value))
+
+#    define BLK_PROBE1(name, a)                                                \
+        __asm__ __volatile__(PROBE_ASM(name, "8@%0") ::PROBE_ARG(a))
+#    define BLK_PROBE2(name, a, b)                                             \
+        __asm__ __volatile__(PROBE_ASM(name, "8@%0 8@%1") ::PROBE_ARG(a),      \
+                             PROBE_ARG(b))
+#    define BLK_PROBE3(name, a, b, c)                                          \
+        __asm__ __volatile__(PROBE_ASM(name, "8@%0 8@%1 8@%2") ::PROBE_ARG(a), \
+                             PROBE_ARG(b), PROBE_ARG(c))
+
+#else
+
+#    define BLK_PROBE1(name, a) ((void)(a))
+#    define BLK_PROBE2(name, a, b) ((void)(a), (void)(b))
+#    define BLK_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+
+#endif
+
+#endif /* ! PROBE_H */
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+
+#include "reclaim.h"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "limit.h"
+#include "thread.h"
+
+struct blk_reclaim_entry
+{
+    // Written over the span header, which is no longer needed
+    struct blk_reclaim_entry *next;
+    size_t size;
+};
+
+// Mappings waiting to be unmapped, pushed by any thread and taken all at
+// once by the reclaimer.
+static struct blk_reclaim_entry *pending;
+
+// 1 while the reclaimer sleeps or is about to, it is then woken on push.
+static uint32_t sleeping;
+
+static bool enabled;
+
+bool blk_reclaim_enabled(void)
+{
+    return enabled;
+}
+
+void blk_reclaim_push(void *addr, size_t size)
+{
+    struct blk_reclaim_entry *entry = addr;
+    entry->size = size;
+    entry->next = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pending, &entry->next, entry, true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        continue;
+    }
+
+    // Only pay for the system call when the reclaimer went to sleep.
+    if (__atomic_exchange_n(&sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+        syscall(SYS_futex, &sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static void blk_reclaim_unmap(struct blk_reclaim_entry *entry)
+{
+    while (entry)
+    {
+        // The mapping counts against the budget until it is gone.
+        struct blk_reclaim_entry *next = entry->next;
+        size_t size = entry->size;
+        munmap(entry, size);
+        blk_limit_uncharge(size);
+        entry = next;
+    }
+}
+
+static void blk_reclaim_after_fork(void)
+{
+    // The thread is not copied in the child, it unmaps its spans itself.
+    enabled = false;
+    blk_reclaim_unmap(__atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE));
+}
+
+static void *blk_reclaim_routine(void *arg)
+{
+    (void)arg;
+
+    // Woken without preempting the thread that freed the span.
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+
+    while (true)
+    {
+        struct blk_reclaim_entry *entry =
+            __atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE);
+        if (!entry)
+        {
+            // Check the queue again once marked as sleeping, a push in
+            // between would otherwise be missed.
+            __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&pending, __ATOMIC_SEQ_CST))
+            {
+                syscall(SYS_futex, &sleeping, FUTEX_WAIT_PRIVATE, 1, NULL,
+                        NULL, 0);
+            }
+
+            __atomic_store_n(&sleeping, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // No allocator lock is held here.
+        blk_reclaim_unmap(entry);
+    }
+
+    return NULL;
+}
+
+__attribute__((constructor)) static void blk_reclaim_start(void)
+{
+    // The background release is opt-in.
+    if (!blk_config_get()->async_release)
+    {
+        return;
+    }
+
+    // Spans are unmapped in place until the thread runs.
+    enabled = blk_start_thread(blk_reclaim_routine, NULL);
+    if (enabled)
+    {
+        pthread_atfork(NULL, NULL, blk_reclaim_after_fork);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// @brief Tell if spans are unmapped by the background thread, started at
+/// load time when async_release is set in the configuration.
+/// @return true if they are, false if the caller unmaps them itself.
+bool blk_reclaim_enabled(void);
+
+/// @brief Hand a mapping to the background thread. Its first bytes are used
+/// to queue it, it should already be out of every list and of the page map.
+/// It is uncharged from the memory budget once unmapped.
+/// @param addr The start of the mapping.
+/// @param size The size of the mapping.
+void blk_reclaim_push(void *addr, size_t size);
+
+#endif /* ! RECLAIM_H */
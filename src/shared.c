@@ -0,0 +1,353 @@
+#include "shared.h"
+
+#include <sys/stat.h>
+
+#include "libmalloc.h"
+
+/// @brief Macro that define the offset of the first block, after the header.
+#define SHARED_FIRST_BLOCK blk_align_size(sizeof(blk_shared_heap))
+
+static void *blk_shared_at(blk_shared_heap *heap, uint64_t offset)
+{
+    uint8_t *base = (uint8_t *)heap;
+    return base + offset;
+}
+
+static uint64_t blk_shared_offset_of(blk_shared_heap *heap, const void *ptr)
+{
+    return (const uint8_t *)ptr - (const uint8_t *)heap;
+}
+
+static blk_shared_meta *blk_shared_meta_at(blk_shared_heap *heap,
+                                           uint64_t offset)
+{
+    return offset ? blk_shared_at(heap, offset) : NULL;
+}
+
+static blk_shared_meta *blk_shared_next(blk_shared_heap *heap,
+                                        blk_shared_meta *blk)
+{
+    // The last block ends with the region.
+    uint64_t next = blk->self + sizeof(blk_shared_meta) + blk->size;
+    return next < heap->size ? blk_shared_at(heap, next) : NULL;
+}
+
+static void blk_shared_insert_free(blk_shared_heap *heap, blk_shared_meta *blk)
+{
+    blk->is_free = true;
+    blk->prev_free = 0;
+    blk->next_free = heap->free_list;
+    if (heap->free_list)
+    {
+        blk_shared_meta_at(heap, heap->free_list)->prev_free = blk->self;
+    }
+
+    heap->free_list = blk->self;
+}
+
+static void blk_shared_remove_free(blk_shared_heap *heap, blk_shared_meta *blk)
+{
+    if (blk->prev_free)
+    {
+        blk_shared_meta_at(heap, blk->prev_free)->next_free = blk->next_free;
+    }
+    else
+    {
+        heap->free_list = blk->next_free;
+    }
+
+    if (blk->next_free)
+    {
+        blk_shared_meta_at(heap, blk->next_free)->prev_free = blk->prev_free;
+    }
+
+    blk->is_free = false;
+    blk->next_free = 0;
+    blk->prev_free = 0;
+}
+
+static void blk_shared_split(blk_shared_heap *heap, blk_shared_meta *blk,
+                             size_t size)
+{
+    // Only split when the rest can hold a block.
+    if (blk->size < size + sizeof(blk_shared_meta) + MIN_DATA_SIZE)
+    {
+        return;
+    }
+
+    blk_shared_meta *new_blk =
+        blk_shared_at(heap, blk->self + sizeof(blk_shared_meta) + size);
+    new_blk->self = blk_shared_offset_of(heap, new_blk);
+    new_blk->prev = blk->self;
+    new_blk->size = blk->size - size - sizeof(blk_shared_meta);
+    blk->size = size;
+
+    blk_shared_meta *next = blk_shared_next(heap, new_blk);
+    if (next)
+    {
+        next->prev = new_blk->self;
+    }
+
+    blk_shared_insert_free(heap, new_blk);
+}
+
+static blk_shared_meta *blk_shared_merge(blk_shared_heap *heap,
+                                         blk_shared_meta *blk)
+{
+    // Absorb the next block, then let the previous one absorb this one.
+    blk_shared_meta *next = blk_shared_next(heap, blk);
+    if (next && next->is_free)
+    {
+        blk_shared_remove_free(heap, next);
+        blk->size += sizeof(blk_shared_meta) + next->size;
+    }
+
+    blk_shared_meta *prev = blk_shared_meta_at(heap, blk->prev);
+    if (prev && prev->is_free)
+    {
+        blk_shared_remove_free(heap, prev);
+        prev->size += sizeof(blk_shared_meta) + blk->size;
+        blk = prev;
+    }
+
+    next = blk_shared_next(heap, blk);
+    if (next)
+    {
+        next->prev = blk->self;
+    }
+
+    return blk;
+}
+
+static blk_shared_meta *blk_shared_meta_of(blk_shared_heap *heap, void *ptr)
+{
+    // Pointers outside of the region or not at the start of a block are
+    // rejected.
+    uint64_t offset = blk_shared_offset_of(heap, ptr);
+    if ((uint8_t *)ptr < (uint8_t *)heap
+        || offset < SHARED_FIRST_BLOCK + sizeof(blk_shared_meta)
+        || offset >= heap->size || offset % MIN_DATA_SIZE)
+    {
+        return NULL;
+    }
+
+    offset -= sizeof(blk_shared_meta);
+    blk_shared_meta *blk = blk_shared_at(heap, offset);
+    return blk->self == offset ? blk : NULL;
+}
+
+static bool blk_shared_validate(blk_shared_heap *heap)
+{
+    // The blocks must tile the region and link back to each other.
+    uint64_t prev = 0;
+    uint64_t offset = SHARED_FIRST_BLOCK;
+    size_t free_count = 0;
+    while (offset < heap->size)
+    {
+        blk_shared_meta *blk = blk_shared_at(heap, offset);
+        if (heap->size - offset < sizeof(blk_shared_meta)
+            || blk->self != offset || blk->prev != prev
+            || blk->size % MIN_DATA_SIZE
+            || blk->size > heap->size - offset - sizeof(blk_shared_meta))
+        {
+            return false;
+        }
+
+        free_count += blk->is_free;
+        prev = offset;
+        offset += sizeof(blk_shared_meta) + blk->size;
+    }
+
+    // Every free block is listed once.
+    uint64_t free_prev = 0;
+    uint64_t free_offset = heap->free_list;
+    while (free_offset && free_count)
+    {
+        blk_shared_meta *blk = blk_shared_at(heap, free_offset);
+        if (free_offset < SHARED_FIRST_BLOCK || free_offset % MIN_DATA_SIZE
+            || free_offset >= heap->size || blk->self != free_offset
+            || !blk->is_free || blk->prev_free != free_prev)
+        {
+            return false;
+        }
+
+        --free_count;
+        free_prev = free_offset;
+        free_offset = blk->next_free;
+    }
+
+    return offset == heap->size && !free_offset && !free_count;
+}
+
+__attribute__((visibility("default"))) blk_shared_heap *
+blk_shared_heap_create(int fd, size_t size)
+{
+    // Round the size up to whole pages.
+    size_t page_size = PAGE_SIZE;
+    if (size > SIZE_MAX - page_size
+        || size < SHARED_FIRST_BLOCK + sizeof(blk_shared_meta) + MIN_DATA_SIZE)
+    {
+        return NULL;
+    }
+
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if (ftruncate(fd, size))
+    {
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, size, PROT_FLAGS, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // A single free block covers the region.
+    blk_shared_heap *heap = addr;
+    heap->magic = 0;
+    heap->size = size;
+    blk_lock_init_shared(&heap->lock);
+    heap->free_list = 0;
+    heap->root = 0;
+
+    blk_shared_meta *blk = blk_shared_at(heap, SHARED_FIRST_BLOCK);
+    blk->self = SHARED_FIRST_BLOCK;
+    blk->prev = 0;
+    blk->size = size - SHARED_FIRST_BLOCK - sizeof(blk_shared_meta);
+    blk_shared_insert_free(heap, blk);
+
+    // Written last, a heap torn by a crash is not opened again.
+    __atomic_store_n(&heap->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+    return heap;
+}
+
+__attribute__((visibility("default"))) blk_shared_heap *
+blk_shared_heap_open(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(blk_shared_heap))
+    {
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_FLAGS, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // The links are offsets, they stay valid wherever the region is mapped.
+    // The lock is only usable once the magic is written.
+    blk_shared_heap *heap = addr;
+    if (__atomic_load_n(&heap->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC
+        || heap->size != (size_t)st.st_size)
+    {
+        munmap(addr, st.st_size);
+        return NULL;
+    }
+
+    // Lock the heap, other processes may be using it.
+    blk_lock_acquire(&heap->lock);
+
+    // Call blk_shared_validate.
+    bool is_valid = blk_shared_validate(heap);
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+
+    if (!is_valid)
+    {
+        munmap(addr, st.st_size);
+        return NULL;
+    }
+
+    return heap;
+}
+
+__attribute__((visibility("default"))) void *
+blk_shared_heap_malloc(blk_shared_heap *heap, size_t size)
+{
+    size_t aligned_size = blk_align_size(size ? size : 1);
+
+    // Lock the heap.
+    blk_lock_acquire(&heap->lock);
+
+    // Find the best block (aka. closest size to aligned_size).
+    blk_shared_meta *best_blk = NULL;
+    blk_shared_meta *blk = blk_shared_meta_at(heap, heap->free_list);
+    while (blk)
+    {
+        if (blk->size >= aligned_size
+            && (!best_blk || blk->size < best_blk->size))
+        {
+            best_blk = blk;
+        }
+
+        blk = blk_shared_meta_at(heap, blk->next_free);
+    }
+
+    if (best_blk)
+    {
+        blk_shared_remove_free(heap, best_blk);
+        blk_shared_split(heap, best_blk, aligned_size);
+    }
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+
+    return best_blk ? best_blk + 1 : NULL;
+}
+
+__attribute__((visibility("default"))) void
+blk_shared_heap_free(blk_shared_heap *heap, void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    // Lock the heap.
+    blk_lock_acquire(&heap->lock);
+
+    // Merge the block with its free neighbours.
+    blk_shared_meta *blk = blk_shared_meta_of(heap, ptr);
+    if (blk && !blk->is_free)
+    {
+        blk_shared_insert_free(heap, blk_shared_merge(heap, blk));
+    }
+
+    // Unlock the heap.
+    blk_lock_release(&heap->lock);
+}
+
+__attribute__((visibility("default"))) size_t
+blk_shared_heap_offset(blk_shared_heap *heap, const void *ptr)
+{
+    return ptr ? blk_shared_offset_of(heap, ptr) : 0;
+}
+
+__attribute__((visibility("default"))) void *
+blk_shared_heap_pointer(blk_shared_heap *heap, size_t offset)
+{
+    return offset ? blk_shared_at(heap, offset) : NULL;
+}
+
+__attribute__((visibility("default"))) void
+blk_shared_heap_set_root(blk_shared_heap *heap, void *ptr)
+{
+    __atomic_store_n(&heap->root, blk_shared_heap_offset(heap, ptr),
+                     __ATOMIC_RELEASE);
+}
+
+__attribute__((visibility("default"))) void *
+blk_shared_heap_root(blk_shared_heap *heap)
+{
+    return blk_shared_heap_pointer(
+        heap, __atomic_load_n(&heap->root, __ATOMIC_ACQUIRE));
+}
+
+__attribute__((visibility("default"))) void
+blk_shared_heap_close(blk_shared_heap *heap)
+{
+    munmap(heap, heap->size);
+}
@@ -0,0 +1,47 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "allocator.h"
+
+/// @brief Macro that define the format of a shared heap, "blkshm01" read as
+/// a little endian integer. Checked when a heap is opened again.
+#define SHARED_MAGIC 0x31306d68736b6c62ULL
+
+// The links of a shared heap are offsets from its start, the same in every
+// process whatever the address it is mapped at.
+struct blk_shared_meta
+{
+    // Offset of the block itself, checked before trusting a pointer
+    uint64_t self;
+
+    // Offset of the previous block in memory, 0 for the first one
+    uint64_t prev;
+
+    // Double linked free list
+    uint64_t next_free;
+    uint64_t prev_free;
+
+    // Block info
+    uint64_t size;
+    uint64_t is_free;
+};
+
+typedef struct blk_shared_meta blk_shared_meta;
+
+// Header at the start of the region, followed by its blocks.
+struct blk_shared_heap
+{
+    uint64_t magic;
+    uint64_t size;
+
+    // Taken by the threads of every process mapping the heap
+    blk_lock lock;
+
+    // Offset of the first free block, 0 when the heap is full
+    uint64_t free_list;
+
+    // Offset of the block the caller finds its data from, 0 if none
+    uint64_t root;
+};
+
+#endif /* ! SHARED_H */
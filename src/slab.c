@@ -0,0 +1,273 @@
+#include "slab.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "latency.h"
+#include "limit.h"
+#include "numa.h"
+#include "pagemap.h"
+
+// Slabs of every arena and class with free objects, the most recently
+// refilled first.
+static blk_slab *partial[NUMA_MAX_NODES][SLAB_CLASSES];
+
+// Descriptors that are not in use, mapped together away from the payload
+// and never unmapped.
+static blk_slab *free_descriptors;
+static blk_lock descriptor_lock;
+
+static bool enabled;
+
+static blk_slab *blk_slab_new_descriptor(void)
+{
+    blk_lock_acquire(&descriptor_lock);
+
+    if (!free_descriptors)
+    {
+        void *addr =
+            mmap(NULL, SLAB_DESCRIPTORS_PER_MAP * sizeof(blk_slab), PROT_FLAGS,
+                 MAP_FLAGS, -1, 0);
+        if (addr == MAP_FAILED)
+        {
+            blk_lock_release(&descriptor_lock);
+            return NULL;
+        }
+
+        blk_slab *descriptors = addr;
+        for (size_t i = 0; i < SLAB_DESCRIPTORS_PER_MAP; ++i)
+        {
+            descriptors[i].next = free_descriptors;
+            free_descriptors = &descriptors[i];
+        }
+    }
+
+    blk_slab *slab = free_descriptors;
+    free_descriptors = slab->next;
+
+    blk_lock_release(&descriptor_lock);
+
+    return slab;
+}
+
+static void blk_slab_delete_descriptor(blk_slab *slab)
+{
+    blk_lock_acquire(&descriptor_lock);
+    slab->next = free_descriptors;
+    free_descriptors = slab;
+    blk_lock_release(&descriptor_lock);
+}
+
+static void blk_slab_link(blk_slab *slab)
+{
+    blk_slab **head = &partial[slab->owner->id][slab->cls];
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head)
+    {
+        (*head)->prev = slab;
+    }
+
+    *head = slab;
+    slab->is_listed = true;
+}
+
+static void blk_slab_unlink(blk_slab *slab)
+{
+    if (slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        partial[slab->owner->id][slab->cls] = slab->next;
+    }
+
+    if (slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->is_listed = false;
+}
+
+static blk_slab *blk_slab_create(blk_allocator *blka, int cls)
+{
+    blk_slab *slab = blk_slab_new_descriptor();
+    if (!slab)
+    {
+        return NULL;
+    }
+
+    // Stay within the memory budget.
+    if (!blk_limit_charge(SLAB_SIZE))
+    {
+        blk_slab_delete_descriptor(slab);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, SLAB_SIZE, PROT_FLAGS, MAP_FLAGS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        blk_limit_uncharge(SLAB_SIZE);
+        blk_slab_delete_descriptor(slab);
+        return NULL;
+    }
+
+    blk_latency_note(PATH_EXTEND);
+
+    // Place the pages on the arena node before they are touched.
+    if (blka->node >= 0)
+    {
+        blk_numa_bind(addr, SLAB_SIZE, blka->node);
+    }
+
+    blk_config_advise(addr, SLAB_SIZE);
+
+    // Set before the pages are indexed, the heap walk reads them through the
+    // page map and locks the owner to read the rest.
+    slab->base = addr;
+    slab->owner = blka;
+    if (!blk_pagemap_set_slab(addr, SLAB_SIZE, slab))
+    {
+        blk_pagemap_set_slab(addr, SLAB_SIZE, NULL);
+        munmap(addr, SLAB_SIZE);
+        blk_limit_uncharge(SLAB_SIZE);
+        blk_slab_delete_descriptor(slab);
+        return NULL;
+    }
+
+    // Every object starts free, the bits past the capacity stay clear.
+    slab->size = blk_percpu_class_size(cls);
+    slab->cls = cls;
+    slab->capacity = SLAB_SIZE / slab->size;
+    slab->free_count = slab->capacity;
+    slab->hint = 0;
+    memset(slab->bitmap, 0, sizeof(slab->bitmap));
+    for (size_t i = 0; i < slab->capacity / 64; ++i)
+    {
+        slab->bitmap[i] = UINT64_MAX;
+    }
+
+    if (slab->capacity % 64)
+    {
+        slab->bitmap[slab->capacity / 64] =
+            ((uint64_t)1 << (slab->capacity % 64)) - 1;
+    }
+
+    blk_slab_link(slab);
+    return slab;
+}
+
+static void blk_slab_destroy(blk_slab *slab)
+{
+    blk_slab_unlink(slab);
+    blk_pagemap_set_slab(slab->base, SLAB_SIZE, NULL);
+    munmap(slab->base, SLAB_SIZE);
+    blk_limit_uncharge(SLAB_SIZE);
+    blk_slab_delete_descriptor(slab);
+}
+
+void blk_slab_init(void)
+{
+    enabled = blk_config_get()->slab;
+    blk_lock_init(&descriptor_lock);
+}
+
+bool blk_slab_enabled(void)
+{
+    return enabled;
+}
+
+blk_slab *blk_slab_of(const void *ptr)
+{
+    return enabled ? blk_pagemap_get_slab(ptr) : NULL;
+}
+
+size_t blk_slab_malloc_batch(blk_allocator *blka, int cls, size_t n,
+                             void **out)
+{
+    size_t count = 0;
+    while (count < n)
+    {
+        blk_slab *slab = partial[blka->id][cls];
+        if (!slab)
+        {
+            slab = blk_slab_create(blka, cls);
+        }
+
+        if (!slab)
+        {
+            break;
+        }
+
+        // Take the lowest free objects, the words before the hint are full.
+        size_t word = slab->hint;
+        while (count < n && slab->free_count)
+        {
+            while (!slab->bitmap[word])
+            {
+                ++word;
+            }
+
+            int bit = __builtin_ctzll(slab->bitmap[word]);
+            slab->bitmap[word] &= slab->bitmap[word] - 1;
+            slab->free_count -= 1;
+            out[count++] = slab->base + (word * 64 + bit) * slab->size;
+        }
+
+        slab->hint = word;
+
+        // Full slabs are only found again through their objects.
+        if (!slab->free_count)
+        {
+            blk_slab_unlink(slab);
+        }
+    }
+
+    return count;
+}
+
+void *blk_slab_malloc(blk_allocator *blka, int cls)
+{
+    void *ptr;
+    return blk_slab_malloc_batch(blka, cls, 1, &ptr) ? ptr : NULL;
+}
+
+void blk_slab_free(blk_slab *slab, void *ptr)
+{
+    // Ignore pointers that are not an allocated object.
+    size_t offset = (uint8_t *)ptr - slab->base;
+    size_t index = offset / slab->size;
+    size_t word = index / 64;
+    uint64_t mask = (uint64_t)1 << (index % 64);
+    if (offset % slab->size || index >= slab->capacity
+        || slab->bitmap[word] & mask)
+    {
+        return;
+    }
+
+    slab->bitmap[word] |= mask;
+    slab->free_count += 1;
+    if (word < slab->hint)
+    {
+        slab->hint = word;
+    }
+
+    if (!slab->is_listed)
+    {
+        blk_slab_link(slab);
+    }
+
+    // Keep a single slab per class when they are all empty.
+    blk_slab **head = &partial[slab->owner->id][slab->cls];
+    if (slab->free_count == slab->capacity && (*head != slab || slab->next))
+    {
+        blk_slab_destroy(slab);
+    }
+}
+
+size_t blk_slab_size(const blk_slab *slab)
+{
+    return slab->size;
+}
@@ -0,0 +1,83 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "allocator.h"
+#include "percpu.h"
+
+/// @brief Macro that define the size of the mapping of a slab.
+#define SLAB_SIZE (64 * 1024)
+
+/// @brief Macro that define the number of size classes, the same as the
+/// caches so objects move between them without conversion.
+#define SLAB_CLASSES PERCPU_CLASSES
+
+/// @brief Macro that define the number of 64-bit words of a free bitmap,
+/// enough for a slab of the smallest class.
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / MIN_DATA_SIZE / 64)
+
+/// @brief Macro that define the number of descriptors mapped at once.
+#define SLAB_DESCRIPTORS_PER_MAP 64
+
+struct blk_slab
+{
+    // Double linked list of the slabs of a class with free objects
+    struct blk_slab *next;
+    struct blk_slab *prev;
+
+    // Slab info
+    uint8_t *base;
+    struct blk_allocator *owner;
+    uint32_t size;
+    uint16_t cls;
+    uint16_t capacity;
+    uint16_t free_count;
+    uint16_t hint;
+    bool is_listed;
+
+    // One bit per object, set while it is free
+    uint64_t bitmap[SLAB_BITMAP_WORDS];
+};
+
+typedef struct blk_slab blk_slab;
+
+/// @brief Enable the slabs when requested by the configuration.
+void blk_slab_init(void);
+
+/// @brief Tell if small requests are served by the slabs.
+/// @return true if they are, false otherwise.
+bool blk_slab_enabled(void);
+
+/// @brief Find the slab holding an object, without taking any lock.
+/// @param ptr The object.
+/// @return The descriptor of the slab, NULL if disabled or not in a slab.
+blk_slab *blk_slab_of(const void *ptr);
+
+/// @brief Allocate objects of a size class in the slabs of an arena. The
+/// arena lock must be held.
+/// @param blka The arena.
+/// @param cls The size class.
+/// @param n The number of objects.
+/// @param out The array receiving the objects.
+/// @return The number of objects allocated, less than n if out of memory.
+size_t blk_slab_malloc_batch(blk_allocator *blka, int cls, size_t n,
+                             void **out);
+
+/// @brief Allocate an object of a size class in the slabs of an arena. The
+/// arena lock must be held.
+/// @param blka The arena.
+/// @param cls The size class.
+/// @return The object, NULL if out of memory.
+void *blk_slab_malloc(blk_allocator *blka, int cls);
+
+/// @brief Free an object of a slab, only its descriptor is written. The lock
+/// of the slab owner must be held.
+/// @param slab The slab.
+/// @param ptr The object.
+void blk_slab_free(blk_slab *slab, void *ptr);
+
+/// @brief Get the size of the objects of a slab.
+/// @param slab The slab.
+/// @return The size of its objects.
+size_t blk_slab_size(const blk_slab *slab);
+
+#endif /* ! SLAB_H */
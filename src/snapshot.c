@@ -0,0 +1,134 @@
+#include "snapshot.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "convert.h"
+
+struct blk_snapshot_stream
+{
+    int fd;
+    size_t used;
+    bool failed;
+    uint8_t buffer[SNAPSHOT_BUFFER];
+};
+
+static void blk_snapshot_flush(struct blk_snapshot_stream *stream)
+{
+    size_t written = 0;
+    while (!stream->failed && written < stream->used)
+    {
+        ssize_t ret = write(stream->fd, stream->buffer + written,
+                            stream->used - written);
+        if (ret < 0 && errno != EINTR)
+        {
+            stream->failed = true;
+        }
+        else if (ret > 0)
+        {
+            written += ret;
+        }
+    }
+
+    stream->used = 0;
+}
+
+static void blk_snapshot_append(struct blk_snapshot_stream *stream,
+                                const void *data, size_t size)
+{
+    if (stream->used + size > SNAPSHOT_BUFFER)
+    {
+        blk_snapshot_flush(stream);
+    }
+
+    memcpy(stream->buffer + stream->used, data, size);
+    stream->used += size;
+}
+
+static uint32_t blk_snapshot_flags(blk_meta *blk)
+{
+    uint32_t flags = 0;
+    if (blk->is_free)
+    {
+        flags |= SNAPSHOT_FREE;
+    }
+
+    if (blk->is_trimmed)
+    {
+        flags |= SNAPSHOT_TRIMMED;
+    }
+
+    if (!blk_validate_checksum(blk))
+    {
+        flags |= SNAPSHOT_CORRUPTED;
+    }
+
+    return flags;
+}
+
+bool blk_snapshot_write(blk_allocator *blka, int fd)
+{
+    struct blk_snapshot_stream stream;
+    stream.fd = fd;
+    stream.used = 0;
+    stream.failed = false;
+
+    // Count the spans.
+    uint64_t spans = 0;
+    for (blk_span *span = blka->spans; span; span = span->next)
+    {
+        ++spans;
+    }
+
+    struct blk_snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.arena = blka->id;
+    header.size = blka->size;
+    header.spans = spans;
+    header.span_header_size = sizeof(blk_span);
+    header.block_header_size = sizeof(blk_meta);
+    blk_snapshot_append(&stream, &header, sizeof(header));
+
+    for (blk_span *span = blka->spans; span; span = span->next)
+    {
+        struct blk_snapshot_span record = { (uintptr_t)span, span->size };
+        blk_snapshot_append(&stream, &record, sizeof(record));
+
+        // Merge the blocks of the same size and state, up to the end block.
+        struct blk_snapshot_run run = { 0, 0, 0 };
+        uint8_t *addr_p = SPAN_TO_U8(span) + sizeof(blk_span);
+        for (blk_meta *blk = U8_TO_BLK(addr_p); !blk->garbage; blk = blk->next)
+        {
+            uint32_t flags = blk_snapshot_flags(blk);
+            if (run.count && run.size == blk->size && run.flags == flags
+                && run.count < UINT32_MAX)
+            {
+                ++run.count;
+                continue;
+            }
+
+            if (run.count)
+            {
+                blk_snapshot_append(&stream, &run, sizeof(run));
+            }
+
+            run.size = blk->size;
+            run.count = 1;
+            run.flags = flags;
+        }
+
+        if (run.count)
+        {
+            blk_snapshot_append(&stream, &run, sizeof(run));
+        }
+
+        // Close the span.
+        struct blk_snapshot_run end = { 0, 0, 0 };
+        blk_snapshot_append(&stream, &end, sizeof(end));
+    }
+
+    blk_snapshot_flush(&stream);
+    return !stream.failed;
+}
@@ -0,0 +1,73 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// @brief Macro that define the magic bytes starting every snapshot.
+#define SNAPSHOT_MAGIC "BLKSNAP"
+
+/// @brief Macro that define the version of the format.
+#define SNAPSHOT_VERSION 1
+
+/// @brief Macro that define the flag of the runs of free blocks.
+#define SNAPSHOT_FREE 0x1
+
+/// @brief Macro that define the flag of the runs of trimmed blocks.
+#define SNAPSHOT_TRIMMED 0x2
+
+/// @brief Macro that define the flag of the runs with an invalid checksum.
+#define SNAPSHOT_CORRUPTED 0x4
+
+// A snapshot is a header followed by its spans, each span record being
+// followed by its runs and a run with a count of 0. A file may hold the
+// snapshots of several allocators one after the other. Fields are in the
+// byte order of the machine that wrote them.
+
+struct blk_snapshot_header
+{
+    // Format
+    char magic[8];
+    uint32_t version;
+
+    // Allocator info
+    uint32_t arena;
+    uint64_t size;
+    uint64_t spans;
+
+    // Layout, to rebuild the addresses of the blocks
+    uint32_t span_header_size;
+    uint32_t block_header_size;
+};
+
+struct blk_snapshot_span
+{
+    uint64_t address;
+    uint64_t size;
+};
+
+struct blk_snapshot_run
+{
+    // Consecutive blocks of the same size and state
+    uint64_t size;
+    uint32_t count;
+    uint32_t flags;
+};
+
+#ifndef SNAPSHOT_NO_WRITER
+
+#    include "allocator.h"
+
+/// @brief Macro that define the size of the buffer the snapshot is streamed
+/// through, on the stack.
+#    define SNAPSHOT_BUFFER 4096
+
+/// @brief Write a binary snapshot of an allocator, without allocating.
+/// @param blka The block allocator, its lock held by the caller.
+/// @param fd The file descriptor to write to.
+/// @return true if it succeeded, false otherwise.
+bool blk_snapshot_write(blk_allocator *blka, int fd);
+
+#endif /* ! SNAPSHOT_NO_WRITER */
+
+#endif /* ! SNAPSHOT_H */
@@ -0,0 +1,24 @@
+#include "thread.h"
+
+#include <pthread.h>
+#include <signal.h>
+
+bool blk_start_thread(void *(*routine)(void *), void *arg)
+{
+    // Keep signals for the application threads, the mask is inherited.
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    bool started = !pthread_create(&thread, &attr, routine, arg);
+
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return started;
+}
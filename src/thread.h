@@ -0,0 +1,13 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdbool.h>
+
+/// @brief Start a detached background thread with every signal blocked, so
+/// the signals of the process keep going to the application threads.
+/// @param routine The function run by the thread.
+/// @param arg The argument of the routine.
+/// @return true if the thread was started, false otherwise.
+bool blk_start_thread(void *(*routine)(void *), void *arg);
+
+#endif /* ! THREAD_H */
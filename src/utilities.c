@@ -164,20 +164,22 @@ int utilities_number_of_free_blocks(blk_allocator *blka)
 
 bool utilities_validate_allocator_size(blk_allocator *blka)
 {
-    size_t total_memory = sizeof(blk_allocator);
+    size_t total_memory = 0;
     size_t allocated_memory = 0;
     struct blk_meta *current = blka->meta;
     while (current)
     {
+        // Every page starts with the header of its span.
         if (current->garbage)
         {
             allocated_memory += current->garbage;
+            total_memory += sizeof(blk_span);
         }
         total_memory += sizeof(blk_meta) + current->size;
         current = current->next;
     }
 
-    return total_memory == allocated_memory;
+    return total_memory == allocated_memory && allocated_memory == blka->size;
 }
 
 size_t utilities_total_allocator_size(blk_allocator *blka)
@@ -225,8 +227,14 @@ bool utilities_validate_normal_list(blk_allocator *blka)
 
 bool utilities_validate_free_list(blk_allocator *blka)
 {
+    // Empty while the free blocks are all in the wilderness.
     blk_meta *prev = blka->free_list;
-    if (!prev || prev->prev_free || !prev->is_free)
+    if (!prev)
+    {
+        return true;
+    }
+
+    if (prev->prev_free || !prev->is_free || prev == blka->wilderness)
     {
         return false;
     }
@@ -234,7 +242,8 @@ bool utilities_validate_free_list(blk_allocator *blka)
     for (blk_meta *current = prev->next_free; current;
          current = current->next_free)
     {
-        if (current->prev_free != prev || !current->is_free)
+        if (current->prev_free != prev || !current->is_free
+            || current == blka->wilderness)
         {
             return false;
         }
@@ -250,6 +259,7 @@ void utilities_print_allocator(blk_allocator *blka, FILE *fd)
     void *blka_p = blka;
     void *meta_p = blka->meta;
     void *free_list_p = blka->free_list;
+    void *wilderness_p = blka->wilderness;
 
     fprintf(fd, "\n┏━━━━━━━━━━━━━━━━╸ ALLOCATOR ╺━━━━━━━━━━━━━━━━┓\n");
     fprintf(fd, "┃ %-20s : %-20p ┃\n", "Address", blka_p);
@@ -258,6 +268,7 @@ void utilities_print_allocator(blk_allocator *blka, FILE *fd)
     fprintf(fd, "┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
     fprintf(fd, "┃ %-20s : %-20p ┃\n", "Meta", meta_p);
     fprintf(fd, "┃ %-20s : %-20p ┃\n", "Free List", free_list_p);
+    fprintf(fd, "┃ %-20s : %-20p ┃\n", "Wilderness", wilderness_p);
     fprintf(fd, "┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
     fprintf(fd, "┃ %-20s : %-20i ┃\n", "Blocks",
             utilities_number_of_blocks(blka));
@@ -273,6 +284,12 @@ void utilities_print_allocator(blk_allocator *blka, FILE *fd)
             utilities_validate_normal_list(blka) ? "Yes" : "No");
     fprintf(fd, "┃ %-20s : %-20s ┃\n", "Free List Valid",
             utilities_validate_free_list(blka) ? "Yes" : "No");
+    fprintf(fd, "┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    fprintf(fd, "┃ %-20s : %-20lu ┃\n", "Lock Acquisitions",
+            blka->lock.acquisitions);
+    fprintf(fd, "┃ %-20s : %-20lu ┃\n", "Lock Contended",
+            blka->lock.contended);
+    fprintf(fd, "┃ %-20s : %-20lu ┃\n", "Lock Wait (ns)", blka->lock.wait_ns);
     fprintf(fd, "┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n\n");
 }
 
@@ -286,10 +303,10 @@ void utilities_print_sizes(FILE *fd)
     fprintf(fd, "┃ %-20s : %-20zu ┃\n", "size_t", sizeof(size_t));
     fprintf(fd, "┃ %-20s : %-20zu ┃\n", "bool", sizeof(bool));
     fprintf(fd, "┃ %-20s : %-20zu ┃\n", "char data[]", sizeof(data));
-    fprintf(fd, "┃ %-20s : %-20zu ┃\n", "pthread_mutex_t",
-            sizeof(pthread_mutex_t));
+    fprintf(fd, "┃ %-20s : %-20zu ┃\n", "blk_lock", sizeof(blk_lock));
     fprintf(fd, "┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
     fprintf(fd, "┃ %-20s : %-20zu ┃\n", "blk_allocator", sizeof(blk_allocator));
     fprintf(fd, "┃ %-20s : %-20zu ┃\n", "blk_meta", sizeof(blk_meta));
+    fprintf(fd, "┃ %-20s : %-20zu ┃\n", "blk_span", sizeof(blk_span));
     fprintf(fd, "┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n\n");
 }
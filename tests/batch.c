@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the number of blocks of a batch.
+#define BATCH 64
+
+/// @brief Macro that define the size of the blocks of a batch.
+#define SIZE 48
+
+/// @brief Macro that define the memory budget the test runs with.
+#define LIMIT "memory_limit:67108864"
+
+struct span
+{
+    // Range that should be covered by a single free block, and if a block
+    // of the walk cuts it
+    uintptr_t start;
+    uintptr_t end;
+    int split;
+};
+
+struct marks
+{
+    // Blocks looked for, and how the walk reported them
+    void **ptrs;
+    size_t count;
+    int used[BATCH];
+};
+
+static void find_split(void *ptr, size_t size, int used, void *arg)
+{
+    struct span *span = arg;
+    uintptr_t start = (uintptr_t)ptr;
+    if (start < span->end && start + size > span->start
+        && (used || start > span->start || start + size < span->end))
+    {
+        span->split = 1;
+    }
+}
+
+static void mark_blocks(void *ptr, size_t size, int used, void *arg)
+{
+    struct marks *marks = arg;
+    (void)size;
+    for (size_t i = 0; i < marks->count; ++i)
+    {
+        if (marks->ptrs[i] == ptr)
+        {
+            marks->used[i] = used;
+        }
+    }
+}
+
+static int test_carve(void **out)
+{
+    if (malloc_batch(SIZE, BATCH, out) != BATCH)
+    {
+        fprintf(stderr, "malloc_batch failed\n");
+        return 1;
+    }
+
+    // The blocks are carved one after the other from a single free block.
+    uintptr_t stride = (uintptr_t)out[1] - (uintptr_t)out[0];
+    for (size_t i = 0; i < BATCH; ++i)
+    {
+        if (i && (uintptr_t)out[i] - (uintptr_t)out[i - 1] != stride)
+        {
+            fprintf(stderr, "block %zu is not next to the previous one\n", i);
+            return 1;
+        }
+
+        memset(out[i], (int)i, SIZE);
+    }
+
+    return stride >= SIZE ? 0 : 1;
+}
+
+static int test_coalesce(void)
+{
+    void *out[BATCH];
+    if (test_carve(out))
+    {
+        return 1;
+    }
+
+    // Reversed, with holes, so the batch has to be sorted to be coalesced.
+    void *ptrs[BATCH + BATCH / 4];
+    size_t n = 0;
+    for (size_t i = 0; i < BATCH; ++i)
+    {
+        if (i % 4 == 0)
+        {
+            ptrs[n++] = NULL;
+        }
+
+        ptrs[n++] = out[BATCH - 1 - i];
+    }
+
+    free_batch(ptrs, n);
+
+    // A single free block now spans the whole batch, unless its span was
+    // unmapped once entirely free.
+    struct span span = { (uintptr_t)out[0], (uintptr_t)out[BATCH - 1] + SIZE,
+                         0 };
+    if (blk_heap_iterate(find_split, &span) || span.split)
+    {
+        fprintf(stderr, "the batch was not coalesced\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_partial(void)
+{
+    void *out[BATCH];
+    if (test_carve(out))
+    {
+        return 1;
+    }
+
+    // Free every other block, the others keep their data.
+    void *ptrs[BATCH / 2];
+    for (size_t i = 0; i < BATCH / 2; ++i)
+    {
+        ptrs[i] = out[2 * i];
+    }
+
+    free_batch(ptrs, BATCH / 2);
+
+    struct marks marks = { out, BATCH, { 0 } };
+    if (blk_heap_iterate(mark_blocks, &marks))
+    {
+        return 1;
+    }
+
+    for (size_t i = 1; i < BATCH; i += 2)
+    {
+        uint8_t *block = out[i];
+        if (!marks.used[i] || marks.used[i - 1] || block[0] != (uint8_t)i
+            || block[SIZE - 1] != (uint8_t)i)
+        {
+            fprintf(stderr, "block %zu was damaged by the batch\n", i);
+            return 1;
+        }
+
+        ptrs[i / 2] = out[i];
+    }
+
+    free_batch(ptrs, BATCH / 2);
+    return 0;
+}
+
+static int test_out_of_memory(void)
+{
+    // More than the budget: nothing is allocated and out is left alone.
+    void *out[BATCH];
+    for (size_t i = 0; i < BATCH; ++i)
+    {
+        out[i] = out;
+    }
+
+    if (malloc_batch(4 << 20, BATCH, out) != 0)
+    {
+        fprintf(stderr, "malloc_batch went over the budget\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < BATCH; ++i)
+    {
+        if (out[i] != out)
+        {
+            fprintf(stderr, "a failed batch wrote block %zu\n", i);
+            return 1;
+        }
+    }
+
+    // The failed batch charged nothing, a smaller one still fits.
+    if (malloc_batch(1 << 20, 32, out) != 32)
+    {
+        fprintf(stderr, "a failed batch kept part of the budget\n");
+        return 1;
+    }
+
+    free_batch(out, 32);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    // Run again within a budget, so the batches can run out of memory.
+    if (!getenv("BLK_MALLOC_CONF"))
+    {
+        setenv("BLK_MALLOC_CONF", LIMIT, 1);
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+
+    return test_coalesce() || test_partial() || test_out_of_memory();
+}
@@ -0,0 +1,153 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the size of the objects.
+#define SIZE 100
+
+struct lookup
+{
+    // Block looked for, and how the walk reported it
+    const void *ptr;
+    int found;
+    int used;
+};
+
+static void find_block(void *ptr, size_t size, int used, void *arg)
+{
+    lookup *block = static_cast<lookup *>(arg);
+    (void)size;
+    if (ptr == block->ptr)
+    {
+        block->found = 1;
+        block->used = used;
+    }
+}
+
+static bool is_used(const void *ptr)
+{
+    lookup block = { ptr, 0, 0 };
+    return !blk_heap_iterate(find_block, &block) && block.found && block.used;
+}
+
+static bool check(void *ptr, size_t alignment)
+{
+    if (!ptr || reinterpret_cast<uintptr_t>(ptr) % alignment)
+    {
+        std::fprintf(stderr, "%p is not aligned on %zu\n", ptr, alignment);
+        return false;
+    }
+
+    std::memset(ptr, 0x42, SIZE);
+    if (!is_used(ptr))
+    {
+        std::fprintf(stderr, "%p is not allocated\n", ptr);
+        return false;
+    }
+
+    return true;
+}
+
+static bool released(const void *ptr)
+{
+    if (is_used(ptr))
+    {
+        std::fprintf(stderr, "%p is still allocated\n", ptr);
+        return false;
+    }
+
+    return true;
+}
+
+static int test_sized(void)
+{
+    // The size gives the class of the block without reading its header.
+    void *ptr = ::operator new(SIZE);
+    if (!check(ptr, alignof(std::max_align_t)))
+    {
+        return 1;
+    }
+
+    ::operator delete(ptr, SIZE);
+    if (!released(ptr))
+    {
+        return 1;
+    }
+
+    ptr = ::operator new[](SIZE);
+    if (!check(ptr, alignof(std::max_align_t)))
+    {
+        return 1;
+    }
+
+    ::operator delete[](ptr, SIZE);
+    return released(ptr) ? 0 : 1;
+}
+
+static int test_aligned(void)
+{
+    for (size_t alignment = 32; alignment <= 4096; alignment *= 2)
+    {
+        std::align_val_t align = static_cast<std::align_val_t>(alignment);
+
+        void *ptr = ::operator new(SIZE, align);
+        if (!check(ptr, alignment))
+        {
+            return 1;
+        }
+
+        ::operator delete(ptr, align);
+        if (!released(ptr))
+        {
+            return 1;
+        }
+
+        ptr = ::operator new[](SIZE, align, std::nothrow);
+        if (!check(ptr, alignment))
+        {
+            return 1;
+        }
+
+        ::operator delete[](ptr, SIZE, align);
+        if (!released(ptr))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_failures(void)
+{
+    // The nothrow variants return NULL, the others throw.
+    std::align_val_t align = static_cast<std::align_val_t>(64);
+    if (::operator new(SIZE_MAX / 2, align, std::nothrow))
+    {
+        return 1;
+    }
+
+    try
+    {
+        ::operator delete(::operator new(SIZE_MAX / 2));
+        return 1;
+    }
+    catch (const std::bad_alloc &)
+    {
+    }
+
+    // A zero alignment is not a power of two.
+    void *ptr;
+    return posix_memalign(&ptr, 0, SIZE) == EINVAL ? 0 : 1;
+}
+
+int main(void)
+{
+    return test_sized() || test_aligned() || test_failures();
+}
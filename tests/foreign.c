@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/libmalloc.h"
+
+/// @brief Macro that define the size of the blocks handed out by glibc.
+#define SIZE 200
+
+/// @brief Macro that define the size they grow to.
+#define NEW_SIZE 40000
+
+// Entry point of glibc malloc, its blocks are foreign to the library.
+extern void *__libc_malloc(size_t size);
+
+struct lookup
+{
+    // Block looked for, and if the walk reported it
+    const void *ptr;
+    int found;
+};
+
+static void find_block(void *ptr, size_t size, int used, void *arg)
+{
+    struct lookup *lookup = arg;
+    (void)size;
+    (void)used;
+    if (ptr == lookup->ptr)
+    {
+        lookup->found = 1;
+    }
+}
+
+static int test_glibc(void)
+{
+    uint8_t *ptr = __libc_malloc(SIZE);
+    if (!ptr)
+    {
+        return 1;
+    }
+
+    memset(ptr, 0x5a, SIZE);
+
+    // The heap walk does not know it.
+    struct lookup lookup = { ptr, 0 };
+    if (blk_heap_iterate(find_block, &lookup) || lookup.found)
+    {
+        fprintf(stderr, "a foreign block was walked\n");
+        return 1;
+    }
+
+    // realloc() and free() forward it to glibc.
+    uint8_t *grown = realloc(ptr, NEW_SIZE);
+    if (!grown)
+    {
+        return 1;
+    }
+
+    for (size_t i = 0; i < SIZE; ++i)
+    {
+        if (grown[i] != 0x5a)
+        {
+            fprintf(stderr, "realloc lost byte %zu\n", i);
+            return 1;
+        }
+    }
+
+    free(grown);
+    free(__libc_malloc(SIZE));
+    return 0;
+}
+
+static int test_cache(void)
+{
+    blk_cache *cache = blk_cache_create(SIZE, 0, NULL, NULL);
+    if (!cache)
+    {
+        return 1;
+    }
+
+    // free() gives an object back to its cache, which hands it out again.
+    void *object = blk_cache_alloc(cache);
+    free(object);
+    if (blk_cache_alloc(cache) != object)
+    {
+        fprintf(stderr, "free did not give the object back to its cache\n");
+        return 1;
+    }
+
+    // It moves to the arenas when it grows.
+    memset(object, 0x3c, SIZE);
+    uint8_t *grown = realloc(object, NEW_SIZE);
+    if (!grown || grown[0] != 0x3c || grown[SIZE - 1] != 0x3c)
+    {
+        fprintf(stderr, "realloc lost the object\n");
+        return 1;
+    }
+
+    free(grown);
+    blk_cache_destroy(cache);
+    return 0;
+}
+
+int main(void)
+{
+    return test_glibc() || test_cache();
+}
@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// @brief Macro that define the size requested, sampled blocks keep it as
+/// their usable size while the arenas round it up.
+#define SIZE 33
+
+/// @brief Macro that define the most allocations tried before one is
+/// sampled.
+#define TRIES 1000
+
+static void use_after_free(void)
+{
+    // Find a sampled block.
+    char *ptr = NULL;
+    for (int i = 0; i < TRIES && !ptr; ++i)
+    {
+        ptr = malloc(SIZE);
+        if (malloc_usable_size(ptr) != SIZE)
+        {
+            ptr = NULL;
+        }
+    }
+
+    if (!ptr)
+    {
+        _exit(2);
+    }
+
+    free(ptr);
+    *(volatile char *)ptr = 1;
+    _exit(3);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    // Run again with every allocation sampled.
+    if (!getenv("BLK_GUARD_RATE"))
+    {
+        setenv("BLK_GUARD_RATE", "1", 1);
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+
+    int fds[2];
+    if (pipe(fds))
+    {
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return 1;
+    }
+
+    if (!pid)
+    {
+        // The report goes to stderr, read by the parent.
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        use_after_free();
+    }
+
+    close(fds[1]);
+    char report[16384];
+    size_t length = 0;
+    ssize_t ret;
+    while (length < sizeof(report) - 1
+           && (ret = read(fds[0], report + length,
+                          sizeof(report) - 1 - length)) > 0)
+    {
+        length += ret;
+    }
+
+    report[length] = '\0';
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid)
+    {
+        return 1;
+    }
+
+    // The access crashes after the report, with both stacks.
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV)
+    {
+        fprintf(stderr, "the use after free did not crash\n");
+        return 1;
+    }
+
+    if (!strstr(report, "use-after-free on ") || !strstr(report, "allocated")
+        || !strstr(report, "freed"))
+    {
+        fprintf(stderr, "unexpected report:\n%s", report);
+        return 1;
+    }
+
+    return 0;
+}
@@ -60,6 +60,16 @@ printf "├──────┼────────────────
 run_test gimp --version
 printf "├──────┼────────────────────────────────────────────┤\n"
 run_test chromium --version
+printf "├──────┼────────────────────────────────────────────┤\n"
+run_test tests/batch
+printf "├──────┼────────────────────────────────────────────┤\n"
+run_test tests/guard
+printf "├──────┼────────────────────────────────────────────┤\n"
+run_test tests/delete
+printf "├──────┼────────────────────────────────────────────┤\n"
+run_test tests/foreign
+printf "├──────┼────────────────────────────────────────────┤\n"
+run_test tests/wilderness
 printf "├──────┴────────────────────────────────────────────┤\n"
 printf "│ Total: %-2i / %2i Tests Successful                   │\n" "$successful" "$total"
 printf "└───────────────────────────────────────────────────┘\n\n"
@@ -0,0 +1,86 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/personality.h>
+#include <unistd.h>
+
+/// @brief Macro that define the number of blocks allocated.
+#define BLOCKS 100000
+
+/// @brief Macro that define the size of the blocks, above the per-CPU
+/// classes so they are carved from the wilderness.
+#define SIZE 1000
+
+static uint8_t *blocks[BLOCKS];
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    // Run again with mappings placed upwards, so the pages after the
+    // wilderness are usually free and it can grow in place.
+    int persona = personality(0xffffffff);
+    if (persona != -1 && !(persona & ADDR_COMPAT_LAYOUT))
+    {
+        personality(persona | ADDR_COMPAT_LAYOUT);
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+
+    for (size_t i = 0; i < BLOCKS; ++i)
+    {
+        blocks[i] = malloc(SIZE);
+        if (!blocks[i])
+        {
+            return 1;
+        }
+
+        memset(blocks[i], (int)i, SIZE);
+    }
+
+    // Blocks carved one after the other make runs, a run ends where a span
+    // was mapped. A span mapped anew holds at most what was mapped before,
+    // a longer run grew in place.
+    uintptr_t stride = (uintptr_t)blocks[2] - (uintptr_t)blocks[1];
+    size_t before = 0;
+    size_t run = stride;
+    size_t runs = 0;
+    int grown = 0;
+    for (size_t i = 1; i <= BLOCKS; ++i)
+    {
+        if (i < BLOCKS
+            && (uintptr_t)blocks[i] - (uintptr_t)blocks[i - 1] == stride)
+        {
+            run += stride;
+            continue;
+        }
+
+        grown |= before && run > 2 * before + (1 << 20);
+        before += run;
+        run = stride;
+        ++runs;
+    }
+
+    // Grown geometrically, few spans are mapped.
+    if (!grown || runs > 32)
+    {
+        fprintf(stderr, "%zu runs, grown in place: %d\n", runs, grown);
+        return 1;
+    }
+
+    for (size_t i = 0; i < BLOCKS; ++i)
+    {
+        if (blocks[i][0] != (uint8_t)i || blocks[i][SIZE - 1] != (uint8_t)i)
+        {
+            fprintf(stderr, "block %zu was damaged by the growth\n", i);
+            return 1;
+        }
+
+        free(blocks[i]);
+    }
+
+    return 0;
+}
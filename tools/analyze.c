@@ -0,0 +1,430 @@
+#define SNAPSHOT_NO_WRITER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/snapshot.h"
+
+/// @brief Macro that define the number of power of two size classes.
+#define HISTOGRAM_CLASSES 48
+
+/// @brief Macro that define the width of a span in the free-space map.
+#define MAP_WIDTH 64
+
+struct snapshot
+{
+    const struct blk_snapshot_header *header;
+    const uint8_t *spans;
+    const uint8_t *end;
+};
+
+struct histogram
+{
+    uint64_t used_blocks[HISTOGRAM_CLASSES];
+    uint64_t used_bytes[HISTOGRAM_CLASSES];
+    uint64_t free_blocks[HISTOGRAM_CLASSES];
+    uint64_t free_bytes[HISTOGRAM_CLASSES];
+};
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    size_t capacity = 1 << 16;
+    uint8_t *data = malloc(capacity);
+    *size = 0;
+    size_t ret;
+    while (data && (ret = fread(data + *size, 1, capacity - *size, file)) > 0)
+    {
+        *size += ret;
+        if (*size == capacity)
+        {
+            capacity *= 2;
+            uint8_t *temp = realloc(data, capacity);
+            if (!temp)
+            {
+                free(data);
+            }
+
+            data = temp;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+/// @brief Check the snapshot starting at data and find where it ends.
+/// @return The end of the snapshot, NULL if it is truncated or invalid.
+static const uint8_t *parse_snapshot(const uint8_t *data, const uint8_t *end,
+                                     struct snapshot *snapshot)
+{
+    if ((size_t)(end - data) < sizeof(struct blk_snapshot_header))
+    {
+        return NULL;
+    }
+
+    snapshot->header = (const void *)data;
+    if (memcmp(snapshot->header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))
+        || snapshot->header->version != SNAPSHOT_VERSION)
+    {
+        return NULL;
+    }
+
+    data += sizeof(struct blk_snapshot_header);
+    snapshot->spans = data;
+    for (uint64_t i = 0; i < snapshot->header->spans; ++i)
+    {
+        if ((size_t)(end - data) < sizeof(struct blk_snapshot_span))
+        {
+            return NULL;
+        }
+
+        data += sizeof(struct blk_snapshot_span);
+        const struct blk_snapshot_run *run;
+        do
+        {
+            if ((size_t)(end - data) < sizeof(struct blk_snapshot_run))
+            {
+                return NULL;
+            }
+
+            run = (const void *)data;
+            data += sizeof(struct blk_snapshot_run);
+        } while (run->count);
+    }
+
+    snapshot->end = data;
+    return data;
+}
+
+static int size_class(uint64_t size)
+{
+    int cls = 0;
+    while (cls + 1 < HISTOGRAM_CLASSES && ((uint64_t)2 << cls) <= size)
+    {
+        ++cls;
+    }
+
+    return cls;
+}
+
+static void print_summary(const struct snapshot *snapshot)
+{
+    uint64_t blocks = 0;
+    uint64_t free_blocks = 0;
+    uint64_t used_bytes = 0;
+    uint64_t free_bytes = 0;
+    uint64_t largest_free = 0;
+    uint64_t corrupted = 0;
+
+    const uint8_t *data = snapshot->spans;
+    for (uint64_t i = 0; i < snapshot->header->spans; ++i)
+    {
+        data += sizeof(struct blk_snapshot_span);
+        for (const struct blk_snapshot_run *run = (const void *)data;
+             run->count; run = (const void *)data)
+        {
+            data += sizeof(struct blk_snapshot_run);
+            blocks += run->count;
+            corrupted += run->flags & SNAPSHOT_CORRUPTED ? run->count : 0;
+            if (run->flags & SNAPSHOT_FREE)
+            {
+                free_blocks += run->count;
+                free_bytes += run->size * run->count;
+                largest_free =
+                    run->size > largest_free ? run->size : largest_free;
+            }
+            else
+            {
+                used_bytes += run->size * run->count;
+            }
+        }
+
+        data += sizeof(struct blk_snapshot_run);
+    }
+
+    // Share of the free memory that cannot serve a request of its total size.
+    double fragmentation =
+        free_bytes ? 1.0 - (double)largest_free / free_bytes : 0.0;
+
+    printf("Arena %u:\n", snapshot->header->arena);
+    printf("  mapped               = %20lu\n",
+           (unsigned long)snapshot->header->size);
+    printf("  spans                = %20lu\n",
+           (unsigned long)snapshot->header->spans);
+    printf("  blocks               = %20lu\n", (unsigned long)blocks);
+    printf("  free blocks          = %20lu\n", (unsigned long)free_blocks);
+    printf("  used bytes           = %20lu\n", (unsigned long)used_bytes);
+    printf("  free bytes           = %20lu\n", (unsigned long)free_bytes);
+    printf("  largest free block   = %20lu\n", (unsigned long)largest_free);
+    printf("  fragmentation        = %19.1f%%\n", 100.0 * fragmentation);
+    printf("  corrupted blocks     = %20lu\n", (unsigned long)corrupted);
+}
+
+static void print_histogram(const struct snapshot *snapshot)
+{
+    struct histogram histogram;
+    memset(&histogram, 0, sizeof(histogram));
+
+    const uint8_t *data = snapshot->spans;
+    for (uint64_t i = 0; i < snapshot->header->spans; ++i)
+    {
+        data += sizeof(struct blk_snapshot_span);
+        for (const struct blk_snapshot_run *run = (const void *)data;
+             run->count; run = (const void *)data)
+        {
+            data += sizeof(struct blk_snapshot_run);
+            int cls = size_class(run->size);
+            if (run->flags & SNAPSHOT_FREE)
+            {
+                histogram.free_blocks[cls] += run->count;
+                histogram.free_bytes[cls] += run->size * run->count;
+            }
+            else
+            {
+                histogram.used_blocks[cls] += run->count;
+                histogram.used_bytes[cls] += run->size * run->count;
+            }
+        }
+
+        data += sizeof(struct blk_snapshot_run);
+    }
+
+    printf("  %-12s %12s %14s %12s %14s\n", "size <", "used", "used bytes",
+           "free", "free bytes");
+    for (int cls = 0; cls < HISTOGRAM_CLASSES; ++cls)
+    {
+        if (!histogram.used_blocks[cls] && !histogram.free_blocks[cls])
+        {
+            continue;
+        }
+
+        printf("  %-12lu %12lu %14lu %12lu %14lu\n",
+               (unsigned long)2 << cls,
+               (unsigned long)histogram.used_blocks[cls],
+               (unsigned long)histogram.used_bytes[cls],
+               (unsigned long)histogram.free_blocks[cls],
+               (unsigned long)histogram.free_bytes[cls]);
+    }
+}
+
+static void print_map(const struct snapshot *snapshot)
+{
+    // Each cell shows how much of its bytes are used: ' ' none, '.' some,
+    // ':' half, '#' most of them.
+    const uint8_t *data = snapshot->spans;
+    for (uint64_t i = 0; i < snapshot->header->spans; ++i)
+    {
+        const struct blk_snapshot_span *span = (const void *)data;
+        data += sizeof(struct blk_snapshot_span);
+
+        double used[MAP_WIDTH] = { 0 };
+        double cell = (double)span->size / MAP_WIDTH;
+        uint64_t offset = snapshot->header->span_header_size;
+        for (const struct blk_snapshot_run *run = (const void *)data;
+             run->count; run = (const void *)data)
+        {
+            data += sizeof(struct blk_snapshot_run);
+            uint64_t bytes =
+                (run->size + snapshot->header->block_header_size) * run->count;
+            if (!(run->flags & SNAPSHOT_FREE))
+            {
+                // Spread the run over the cells it covers.
+                double run_end = offset + bytes;
+                for (int c = offset / cell; c < MAP_WIDTH && c * cell < run_end;
+                     ++c)
+                {
+                    double start = c * cell > offset ? c * cell : offset;
+                    double stop =
+                        (c + 1) * cell < run_end ? (c + 1) * cell : run_end;
+                    used[c] += stop - start;
+                }
+            }
+
+            offset += bytes;
+        }
+
+        data += sizeof(struct blk_snapshot_run);
+
+        char line[MAP_WIDTH + 1];
+        for (int c = 0; c < MAP_WIDTH; ++c)
+        {
+            double ratio = used[c] / cell;
+            line[c] = ' ';
+            if (ratio > 0.75)
+            {
+                line[c] = '#';
+            }
+            else if (ratio > 0.4)
+            {
+                line[c] = ':';
+            }
+            else if (ratio > 0)
+            {
+                line[c] = '.';
+            }
+        }
+
+        line[MAP_WIDTH] = '\0';
+        printf("  %#14lx %10lu |%s|\n", (unsigned long)span->address,
+               (unsigned long)span->size, line);
+    }
+}
+
+static void print_block(const char *title, uint64_t address,
+                        uint64_t index, const struct blk_snapshot_run *run,
+                        uint64_t prev, uint64_t next, uint64_t garbage,
+                        const struct blk_snapshot_header *header)
+{
+    unsigned long data = address + header->block_header_size;
+
+    printf("%s", title);
+    printf("┃ %-20s : %#-20lx ┃\n", "Address", (unsigned long)address);
+    printf("┃ %-20s : %-20s ┃\n", "Address Aligned",
+           address % 16 == 0 ? "Yes" : "No");
+    printf("┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    printf("┃ %-20s : %-20lu ┃\n", "Index", (unsigned long)index);
+    printf("┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    printf("┃ %-20s : %-20s ┃\n", "Free",
+           run && run->flags & SNAPSHOT_FREE ? "Yes" : "No");
+    printf("┃ %-20s : %-20lu ┃\n", "Size (bytes)",
+           (unsigned long)(run ? run->size : 0));
+    printf("┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    printf("┃ %-20s : %#-20lx ┃\n", "Next", (unsigned long)next);
+    printf("┃ %-20s : %#-20lx ┃\n", "Prev", (unsigned long)prev);
+    printf("┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    printf("┃ %-20s : %-20s ┃\n", "Checksum Valid",
+           run && run->flags & SNAPSHOT_CORRUPTED ? "No" : "Yes");
+    printf("┃ %-20s : %-20s ┃\n", "Trimmed",
+           run && run->flags & SNAPSHOT_TRIMMED ? "Yes" : "No");
+    printf("┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    printf("┃ %-20s : %#-20lx ┃\n", "Data", data);
+    printf("┃ %-20s : %-20s ┃\n", "Data Aligned", data % 16 == 0 ? "Yes" : "No");
+    printf("┠╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌╌┨\n");
+    printf("┃ %-20s : %-20lu ┃\n", "Garbage", (unsigned long)garbage);
+    printf("┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n\n");
+}
+
+static void print_pretty(const struct snapshot *snapshot)
+{
+    const struct blk_snapshot_header *header = snapshot->header;
+    uint64_t index = 0;
+    uint64_t prev = 0;
+
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    const uint8_t *data = snapshot->spans;
+    for (uint64_t i = 0; i < header->spans; ++i)
+    {
+        const struct blk_snapshot_span *span = (const void *)data;
+        data += sizeof(struct blk_snapshot_span);
+
+        uint64_t address = span->address + header->span_header_size;
+        const char *title =
+            "┏━━━━━━━━━━━━━━━━━━━╸START╺━━━━━━━━━━━━━━━━━━━┓\n";
+        for (const struct blk_snapshot_run *run = (const void *)data;
+             run->count; run = (const void *)data)
+        {
+            data += sizeof(struct blk_snapshot_run);
+            for (uint32_t j = 0; j < run->count; ++j)
+            {
+                uint64_t next = address + header->block_header_size + run->size;
+                print_block(title, address, index++, run, prev, next, 0,
+                            header);
+                printf("  %-20s ⇅ %-20s  \n", " ", " ");
+                title = "\n┏━━━━━━━━━━━━━━━━━━━╸BLOCK╺━━━━━━━━━━━━━━━━━━━┓\n";
+                prev = address;
+                address = next;
+            }
+        }
+
+        data += sizeof(struct blk_snapshot_run);
+
+        // The end block links to the first block of the next span.
+        uint64_t next = 0;
+        if (i + 1 < header->spans)
+        {
+            const struct blk_snapshot_span *next_span = (const void *)data;
+            next = next_span->address + header->span_header_size;
+        }
+
+        print_block("\n┏━━━━━━━━━━━━━━━━━━━━╸END╺━━━━━━━━━━━━━━━━━━━━┓\n",
+                    address, index++, NULL, prev, next, span->size, header);
+        if (next)
+        {
+            printf("━━━━━━━━━━━━━━━━━━╸NEXT PAGE╺━━━━━━━━━━━━━━━━━━\n\n");
+        }
+
+        prev = address;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s FILE [summary|histogram|map|pretty]\n",
+                argv[0]);
+        return 1;
+    }
+
+    const char *view = argc == 3 ? argv[2] : NULL;
+    if (view && strcmp(view, "summary") && strcmp(view, "histogram")
+        && strcmp(view, "map") && strcmp(view, "pretty"))
+    {
+        fprintf(stderr, "%s: unknown view '%s'\n", argv[0], view);
+        return 1;
+    }
+
+    size_t size;
+    uint8_t *file = read_file(argv[1], &size);
+    if (!file)
+    {
+        fprintf(stderr, "%s: cannot read '%s'\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    // Without a view, everything but the pretty view is printed.
+    int status = 0;
+    const uint8_t *data = file;
+    while (data < file + size)
+    {
+        struct snapshot snapshot;
+        data = parse_snapshot(data, file + size, &snapshot);
+        if (!data)
+        {
+            fprintf(stderr, "%s: '%s' is not a valid snapshot\n", argv[0],
+                    argv[1]);
+            status = 1;
+            break;
+        }
+
+        if (!view || !strcmp(view, "summary"))
+        {
+            print_summary(&snapshot);
+        }
+
+        if (!view || !strcmp(view, "histogram"))
+        {
+            print_histogram(&snapshot);
+        }
+
+        if (!view || !strcmp(view, "map"))
+        {
+            print_map(&snapshot);
+        }
+
+        if (view && !strcmp(view, "pretty"))
+        {
+            print_pretty(&snapshot);
+        }
+    }
+
+    free(file);
+    return status;
+}